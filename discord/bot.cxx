@@ -10,6 +10,7 @@
 #include <dpp.h>
 #include <filesystem>
 #include <GLFW/glfw3.h>
+#include <pixelconvert.hxx>
 #include <settings.hxx>
 #include <string>
 
@@ -89,20 +90,7 @@ struct BotState
         glBindFramebuffer(GL_FRAMEBUFFER, fbo);
         glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, buffer.data());
 
-        for (uint32_t y = 0; y < height / 2; y++)
-        {
-            for (uint32_t x = 0; x < width; x++)
-            {
-                std::swap(buffer[(y * width + x) * 4 + 0],
-                          buffer[((height - 1 - y) * width + x) * 4 + 0]);
-                std::swap(buffer[(y * width + x) * 4 + 1],
-                          buffer[((height - 1 - y) * width + x) * 4 + 1]);
-                std::swap(buffer[(y * width + x) * 4 + 2],
-                          buffer[((height - 1 - y) * width + x) * 4 + 2]);
-                std::swap(buffer[(y * width + x) * 4 + 3],
-                          buffer[((height - 1 - y) * width + x) * 4 + 3]);
-            }
-        }
+        hydra::pixel::flip_vertical(buffer.data(), buffer.data(), width * 4, height);
         return buffer;
     }
 
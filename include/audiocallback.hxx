@@ -0,0 +1,35 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ringbuffer.hxx>
+
+namespace hydra
+{
+
+    // The body of the audio device callback, kept apart from miniaudio so that
+    // tests/audio_callback_bench.cxx measures the same code. Runs on the realtime audio thread,
+    // must not allocate, lock or otherwise block
+    template <std::size_t count>
+    void fill_audio_device(ringbuffer<count>& buffer, void* out, std::size_t bytes,
+                           std::atomic<uint32_t>& reads, std::atomic<uint64_t>& worst_ns)
+    {
+        auto start = std::chrono::steady_clock::now();
+        buffer.read_padded(out, bytes);
+
+        reads.fetch_add(1, std::memory_order_release);
+        reads.notify_one();
+
+        uint64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                               std::chrono::steady_clock::now() - start)
+                               .count();
+        uint64_t worst = worst_ns.load(std::memory_order_relaxed);
+        if (elapsed > worst)
+        {
+            worst_ns.store(elapsed, std::memory_order_relaxed);
+        }
+    }
+
+} // namespace hydra
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <compatibility.hxx>
+#include <corewrapper.hxx>
+#include <filesystem>
+#include <fmt/format.h>
+#include <fstream>
+#include <json.hpp>
+#include <log.h>
+#include <map>
+#include <settings.hxx>
+#include <string>
+#include <vector>
+#include <writebehind.hxx>
+
+namespace hydra
+{
+
+    // Community cheat databases cover every game in one file. Importing one splits it into a file
+    // per game, named after the hash LoadGame computes, so loading a game only ever reads its own
+    // entries and a database with thousands of codes costs nothing for the other games
+    struct CheatDatabase
+    {
+        static std::filesystem::path GetPath()
+        {
+            return Settings::GetSavePath() / "cheats" / "database";
+        }
+
+        static std::filesystem::path GetGamePath(const std::string& game_hash)
+        {
+            return GetPath() / (game_hash + ".json");
+        }
+
+        // Expects {"<game hash>": [{"name": "...", "code": "..."}, ...], ...}. Games already in
+        // the database are replaced. Returns how many games were imported
+        static size_t Import(const std::filesystem::path& path)
+        {
+            std::ifstream ifs(path);
+            nlohmann::json database = nlohmann::json::parse(ifs, nullptr, false);
+            if (!database.is_object())
+            {
+                log_warn(fmt::format("{} is not a cheat database", path.string()).c_str());
+                return 0;
+            }
+
+            std::error_code error;
+            std::filesystem::create_directories(GetPath(), error);
+            if (error)
+            {
+                log_warn(fmt::format("Failed to create {}: {}", GetPath().string(),
+                                     error.message())
+                             .c_str());
+                return 0;
+            }
+
+            // Hashes are stored lowercase. Keys that only differ in case are the same game, their
+            // lists are merged so that each file is written by exactly one job
+            std::map<std::string, std::vector<const nlohmann::json*>> grouped;
+            for (const auto& [key, cheats] : database.items())
+            {
+                if (!cheats.is_array() || key.empty())
+                    continue;
+                std::string hash = key;
+                std::transform(hash.begin(), hash.end(), hash.begin(),
+                               [](unsigned char c) { return std::tolower(c); });
+                grouped[hash].push_back(&cheats);
+            }
+            std::vector<std::pair<std::string, std::vector<const nlohmann::json*>>> games(
+                std::make_move_iterator(grouped.begin()), std::make_move_iterator(grouped.end()));
+
+            // Mostly small independent writes
+            std::atomic<size_t> imported = 0;
+            hydra::parallel_jobs(games.size(), [&games, &imported](size_t i) {
+                const auto& [hash, lists] = games[i];
+                nlohmann::json cheats = nlohmann::json::array();
+                for (const nlohmann::json* list : lists)
+                {
+                    for (const auto& cheat : *list)
+                    {
+                        std::string code = string_field(cheat, "code");
+                        if (!code.empty())
+                        {
+                            cheats.push_back(
+                                {{"name", string_field(cheat, "name")}, {"code", code}});
+                        }
+                    }
+                }
+                if (hydra::write_file_atomic(GetGamePath(hash), cheats.dump()))
+                    imported++;
+            });
+            return imported;
+        }
+
+        // The database entries for one game, all disabled. Empty if there are none
+        static std::vector<CheatMetadata> Load(const std::string& game_hash)
+        {
+            std::vector<CheatMetadata> ret;
+            std::ifstream ifs(GetGamePath(game_hash));
+            if (!ifs.good())
+                return ret;
+
+            nlohmann::json cheats = nlohmann::json::parse(ifs, nullptr, false);
+            if (!cheats.is_array())
+                return ret;
+
+            ret.reserve(cheats.size());
+            for (const auto& cheat : cheats)
+            {
+                CheatMetadata metadata;
+                metadata.name = string_field(cheat, "name");
+                metadata.code = string_field(cheat, "code");
+                ret.push_back(std::move(metadata));
+            }
+            return ret;
+        }
+
+    private:
+        // Databases come from anywhere, anything that isn't a string counts as missing
+        static std::string string_field(const nlohmann::json& object, const char* key)
+        {
+            if (!object.is_object())
+                return {};
+            auto it = object.find(key);
+            if (it == object.end() || !it->is_string())
+                return {};
+            return *it;
+        }
+    };
+
+} // namespace hydra
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <bit>
 #include <cstdint>
 #include <cstring>
@@ -8,6 +10,8 @@
 #include <limits>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <type_traits>
 #include <utility>
 #include <vector>
@@ -194,6 +198,34 @@ namespace hydra
 #endif
     }
 
+    // Calls func(i) for every i in [0, count) on a few worker threads and waits for them. Unlike
+    // parallel_for the work is allowed to block, lock or do I/O
+    template <class Func>
+    void parallel_jobs(size_t count, Func func)
+    {
+        size_t thread_count =
+            std::min<size_t>(count, std::max(1u, std::thread::hardware_concurrency()));
+        if (thread_count <= 1)
+        {
+            for (size_t i = 0; i < count; i++)
+                func(i);
+            return;
+        }
+
+        std::atomic<size_t> next = 0;
+        std::vector<std::thread> threads;
+        threads.reserve(thread_count);
+        for (size_t t = 0; t < thread_count; t++)
+        {
+            threads.emplace_back([&next, &func, count]() {
+                for (size_t i = next++; i < count; i = next++)
+                    func(i);
+            });
+        }
+        for (auto& thread : threads)
+            thread.join();
+    }
+
     inline std::vector<std::string> split(const std::string& s, char delimiter)
     {
         std::vector<std::string> splits;
@@ -206,14 +238,51 @@ namespace hydra
         return splits;
     }
 
-    inline std::vector<uint8_t> hex_to_bytes(const std::string& cheat)
+    // Value of every hex digit, 0xFF for anything else
+    constexpr std::array<uint8_t, 256> hex_digit_table = []() {
+        std::array<uint8_t, 256> table{};
+        table.fill(0xFF);
+        for (int i = 0; i < 10; i++)
+            table['0' + i] = i;
+        for (int i = 0; i < 6; i++)
+        {
+            table['a' + i] = 10 + i;
+            table['A' + i] = 10 + i;
+        }
+        return table;
+    }();
+
+    // Decodes a cheat code. Whitespace and the separators cheat databases use between words are
+    // skipped, a trailing lone digit becomes a byte of its own. Returns nothing if anything else
+    // is found
+    inline std::vector<uint8_t> hex_to_bytes(std::string_view cheat)
     {
         std::vector<uint8_t> bytes;
-        for (size_t i = 0; i < cheat.size(); i += 2)
+        bytes.reserve(cheat.size() / 2);
+        int high = -1;
+        for (char c : cheat)
         {
-            std::string hex = cheat.substr(i, 2);
-            bytes.push_back((uint8_t)std::stoul(hex, nullptr, 16));
+            uint8_t digit = hex_digit_table[static_cast<uint8_t>(c)];
+            if (digit == 0xFF)
+            {
+                if (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == ':' || c == '-' ||
+                    c == '+')
+                    continue;
+                return {};
+            }
+
+            if (high < 0)
+            {
+                high = digit;
+            }
+            else
+            {
+                bytes.push_back((high << 4) | digit);
+                high = -1;
+            }
         }
+        if (high >= 0)
+            bytes.push_back(high);
         return bytes;
     }
 
@@ -231,4 +300,16 @@ namespace hydra
         return hash;
     }
 
+    // 64-bit FNV-1a, pass the previous result as hash to continue hashing in chunks
+    constexpr uint64_t fnv1a64(const uint8_t* data, size_t size,
+                               uint64_t hash = 0xcbf29ce484222325) noexcept
+    {
+        for (size_t i = 0; i < size; i++)
+        {
+            hash ^= data[i];
+            hash *= 0x100000001b3;
+        }
+        return hash;
+    }
+
 } // namespace hydra
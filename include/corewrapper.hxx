@@ -1,8 +1,12 @@
 #pragma once
 
 #include "hsystem.hxx"
+#include "pixelconvert.hxx"
 #include <cstring>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #if defined(HYDRA_LINUX) || defined(HYDRA_MACOS)
 #include <dlfcn.h>
@@ -13,8 +17,10 @@
 #endif
 #include "scopeguard.hxx"
 #include "stb_image_write.h"
+#include "writebehind.hxx"
 #include <filesystem>
 #include <hydra/core.hxx>
+#include <optional>
 
 namespace hydra
 {
@@ -124,6 +130,54 @@ namespace hydra
         uint32_t handle = hydra::BAD_CHEAT;
     };
 
+    // A core's icon as reported by getInfo, converted to RGBA8
+    struct CoreIcon
+    {
+        int width = 0;
+        int height = 0;
+        std::vector<uint8_t> rgba;
+    };
+
+    // Only needs getInfo, so this works on a core that was opened without creating an emulator
+    inline std::optional<CoreIcon> read_core_icon(const char* (*get_info)(hydra::InfoType))
+    {
+        const char* data = get_info(hydra::InfoType::IconData);
+        const char* width_str = get_info(hydra::InfoType::IconWidth);
+        const char* height_str = get_info(hydra::InfoType::IconHeight);
+        if (data == nullptr || width_str == nullptr || height_str == nullptr)
+            return std::nullopt;
+
+        CoreIcon icon;
+        icon.width = std::atoi(width_str);
+        icon.height = std::atoi(height_str);
+        if (icon.width <= 0 || icon.height <= 0)
+        {
+            printf("Invalid icon size %dx%d\n", icon.width, icon.height);
+            return std::nullopt;
+        }
+
+        icon.rgba.resize(icon.width * icon.height * 4);
+        memcpy(icon.rgba.data(), data, icon.rgba.size());
+
+        // Pixels are 0xRRGGBBAA words
+        hydra::pixel::swizzle(icon.rgba.data(), icon.rgba.data(), icon.width * icon.height,
+                              hydra::pixel::swizzle_reverse);
+        return icon;
+    }
+
+    inline std::vector<uint8_t> encode_png(const CoreIcon& icon)
+    {
+        int size;
+        void* data =
+            stbi_write_png_to_mem(icon.rgba.data(), 0, icon.width, icon.height, 4, &size);
+        if (!data)
+            return {};
+        std::vector<uint8_t> png(size);
+        memcpy(png.data(), data, size);
+        free(data);
+        return png;
+    }
+
     // Should only be made through the factory
     struct EmulatorWrapper
     {
@@ -134,16 +188,34 @@ namespace hydra
         const char* GetInfo(hydra::InfoType type);
         const CheatMetadata& GetCheat(uint32_t handle);
         const std::vector<CheatMetadata>& GetCheats();
+        // Identifies the loaded game, cheats are saved under it. Empty until LoadGame
+        const std::string& GetGameHash() const
+        {
+            return game_hash_;
+        }
 
         bool LoadGame(const std::filesystem::path& path);
         uint32_t EditCheat(const CheatMetadata& cheat, uint32_t old_handle = hydra::BAD_CHEAT);
+        // Adds many cheats at once, enabled or disabled as their metadata says, with a single
+        // save afterwards. Returns the new handles in order, BAD_CHEAT for cheats the core
+        // rejected
+        std::vector<uint32_t> AddCheats(const std::vector<CheatMetadata>& cheats);
+        // Adds this game's entries from the imported cheat database that aren't in the list yet,
+        // disabled. Returns how many were added
+        size_t MergeCheatDatabase();
         void RemoveCheat(uint32_t handle);
         void EnableCheat(uint32_t handle);
         void DisableCheat(uint32_t handle);
 
-        const std::vector<uint8_t>& GetIcon()
+        // The core's icon as a png, encoded and cached on disk on first use. Empty if the core
+        // has no icon
+        const std::vector<uint8_t>& GetIcon();
+
+        // Must be held while the core runs a frame. The cheat functions take it around their
+        // calls into the core, so they can be used from another thread during emulation
+        std::unique_lock<std::mutex> LockCore()
         {
-            return icon_;
+            return std::unique_lock<std::mutex>(core_mutex_);
         }
 
     private:
@@ -157,9 +229,21 @@ namespace hydra
 
         void init_cheats();
         void save_cheats();
-
+        void mark_cheats_dirty();
+        uint32_t add_cheat(const std::vector<uint8_t>& bytes, bool enabled);
+        CheatMetadata* find_cheat(uint32_t handle);
+        void erase_cheat(size_t index);
+
+        // Taken before cheats_mutex_ when both are needed
+        std::mutex core_mutex_;
+        // Kept in the order they were added, with an index from handle to position. Changed only
+        // on the GUI thread, the lock is for the background save reading them
+        std::mutex cheats_mutex_;
         std::vector<CheatMetadata> cheats_;
+        std::unordered_map<uint32_t, size_t> cheat_index_;
         std::vector<uint8_t> icon_;
+        // Declared after the cheats so the final save happens before they are destroyed
+        std::unique_ptr<hydra::WriteBehind> cheat_writer_;
 
         EmulatorWrapper(const EmulatorWrapper&) = delete;
         friend struct EmulatorFactory;
@@ -207,41 +291,6 @@ namespace hydra
             auto emulator = std::shared_ptr<EmulatorWrapper>(
                 new EmulatorWrapper(create_emu_p(), handle, destroy_emu_p, get_info_p));
 
-            if (get_info_p(hydra::InfoType::IconData) != nullptr &&
-                get_info_p(hydra::InfoType::IconWidth) != nullptr &&
-                get_info_p(hydra::InfoType::IconHeight) != nullptr)
-            {
-                int width = std::atoi(get_info_p(hydra::InfoType::IconWidth));
-                int height = std::atoi(get_info_p(hydra::InfoType::IconHeight));
-
-                if (width <= 0 || height <= 0)
-                {
-                    printf("Invalid icon size %dx%d\n", width, height);
-                    return nullptr;
-                }
-
-                std::vector<uint8_t> temp = std::vector<uint8_t>(width * height * 4);
-                memcpy(temp.data(), get_info_p(hydra::InfoType::IconData), temp.size());
-
-                for (size_t i = 0; i < temp.size(); i += 4)
-                {
-                    uint8_t r = temp[i + 0];
-                    uint8_t g = temp[i + 1];
-                    uint8_t b = temp[i + 2];
-                    uint8_t a = temp[i + 3];
-                    temp[i + 0] = a;
-                    temp[i + 1] = b;
-                    temp[i + 2] = g;
-                    temp[i + 3] = r;
-                }
-
-                int size;
-                void* data = stbi_write_png_to_mem(temp.data(), 0, width, height, 4, &size);
-                emulator->icon_.resize(size);
-                memcpy(emulator->icon_.data(), data, size);
-                free(data);
-            }
-
             return emulator;
         }
 
@@ -0,0 +1,342 @@
+#pragma once
+
+#include "mappedfile.hxx"
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace hydra
+{
+
+    // The core database compiled into one flat file, so the downloader can open it with a single
+    // mmap instead of parsing a json per core. Every string is stored once in a string table and
+    // referenced by offset, and each system has a range in a table of entry indices. The layout
+    // is native endian and only ever read on the machine that wrote it, it is rebuilt from the
+    // json whenever it's missing or the version doesn't match
+    class DatabaseIndex
+    {
+    public:
+        static constexpr uint32_t magic = 0x42444448; // "HDDB"
+        static constexpr uint32_t version = 1;
+
+        struct Download
+        {
+            std::string_view os;
+            std::string_view url;
+        };
+
+        struct Entry
+        {
+            std::string_view core_name;
+            std::string_view core_sub_name;
+            std::string_view versioning;
+            std::string_view versioning_url;
+            std::vector<Download> downloads;
+        };
+
+        // One database json, as input to Build
+        struct Source
+        {
+            std::string file_name;
+            uint32_t crc = 0;
+            std::string core_name;
+            std::string core_sub_name;
+            std::string versioning;
+            std::string versioning_url;
+            std::map<std::string, std::string> downloads;
+            std::vector<std::string> systems;
+        };
+
+        DatabaseIndex(const std::filesystem::path& path) : file_(path)
+        {
+            valid_ = file_.Valid() && validate();
+        }
+
+        bool Valid() const
+        {
+            return valid_;
+        }
+
+        size_t SystemCount() const
+        {
+            return header().systems.count;
+        }
+
+        std::string_view SystemName(size_t system) const
+        {
+            return string(record<SystemRecord>(header().systems, system).name);
+        }
+
+        size_t EntryCount(size_t system) const
+        {
+            return record<SystemRecord>(header().systems, system).entry_count;
+        }
+
+        Entry GetEntry(size_t system, size_t i) const
+        {
+            SystemRecord system_record = record<SystemRecord>(header().systems, system);
+            uint32_t index =
+                record<uint32_t>(header().system_entries, system_record.first_entry + i);
+            EntryRecord entry_record = record<EntryRecord>(header().entries, index);
+
+            Entry entry;
+            entry.core_name = string(entry_record.core_name);
+            entry.core_sub_name = string(entry_record.core_sub_name);
+            entry.versioning = string(entry_record.versioning);
+            entry.versioning_url = string(entry_record.versioning_url);
+            entry.downloads.reserve(entry_record.download_count);
+            for (uint32_t j = 0; j < entry_record.download_count; j++)
+            {
+                DownloadRecord download =
+                    record<DownloadRecord>(header().downloads, entry_record.first_download + j);
+                entry.downloads.push_back({string(download.os), string(download.url)});
+            }
+            return entry;
+        }
+
+        // CRC32 of each database file the index was built from, keyed by file name
+        std::unordered_map<std::string, uint32_t> GetFileCrcs() const
+        {
+            std::unordered_map<std::string, uint32_t> crcs;
+            for (uint32_t i = 0; i < header().files.count; i++)
+            {
+                FileRecord file = record<FileRecord>(header().files, i);
+                crcs.emplace(string(file.name), file.crc);
+            }
+            return crcs;
+        }
+
+        // Serializes the sources into the format read above. Systems are sorted by name and keep
+        // the order of the sources within them
+        static std::string Build(const std::vector<Source>& sources)
+        {
+            Builder builder;
+            std::map<std::string, std::vector<uint32_t>> systems;
+            std::vector<EntryRecord> entries;
+            std::vector<DownloadRecord> downloads;
+            std::vector<FileRecord> files;
+
+            for (const Source& source : sources)
+            {
+                uint32_t index = entries.size();
+                EntryRecord entry;
+                entry.core_name = builder.Intern(source.core_name);
+                entry.core_sub_name = builder.Intern(source.core_sub_name);
+                entry.versioning = builder.Intern(source.versioning);
+                entry.versioning_url = builder.Intern(source.versioning_url);
+                entry.first_download = downloads.size();
+                entry.download_count = source.downloads.size();
+                for (const auto& [os, url] : source.downloads)
+                    downloads.push_back({builder.Intern(os), builder.Intern(url)});
+                entries.push_back(entry);
+
+                for (const std::string& system : source.systems)
+                    systems[system].push_back(index);
+                files.push_back({builder.Intern(source.file_name), source.crc});
+            }
+
+            std::vector<SystemRecord> system_records;
+            std::vector<uint32_t> system_entries;
+            for (const auto& [name, indices] : systems)
+            {
+                system_records.push_back({builder.Intern(name),
+                                          static_cast<uint32_t>(system_entries.size()),
+                                          static_cast<uint32_t>(indices.size())});
+                system_entries.insert(system_entries.end(), indices.begin(), indices.end());
+            }
+
+            std::string data(sizeof(Header), '\0');
+            Header header;
+            header.magic = magic;
+            header.version = version;
+            header.systems = append(data, system_records);
+            header.system_entries = append(data, system_entries);
+            header.entries = append(data, entries);
+            header.downloads = append(data, downloads);
+            header.files = append(data, files);
+            header.strings = append(data, builder.strings);
+            std::memcpy(data.data(), &header, sizeof(header));
+            return data;
+        }
+
+    private:
+        struct Table
+        {
+            uint32_t offset = 0;
+            uint32_t count = 0;
+        };
+
+        struct StringRef
+        {
+            uint32_t offset = 0;
+            uint32_t size = 0;
+        };
+
+        struct Header
+        {
+            uint32_t magic;
+            uint32_t version;
+            Table systems;
+            Table system_entries;
+            Table entries;
+            Table downloads;
+            Table files;
+            Table strings;
+        };
+
+        struct SystemRecord
+        {
+            StringRef name;
+            uint32_t first_entry;
+            uint32_t entry_count;
+        };
+
+        struct EntryRecord
+        {
+            StringRef core_name;
+            StringRef core_sub_name;
+            StringRef versioning;
+            StringRef versioning_url;
+            uint32_t first_download;
+            uint32_t download_count;
+        };
+
+        struct DownloadRecord
+        {
+            StringRef os;
+            StringRef url;
+        };
+
+        struct FileRecord
+        {
+            StringRef name;
+            uint32_t crc;
+        };
+
+        // Each string is stored once no matter how many cores use it, urls share their host and
+        // most entries share their versioning type
+        struct Builder
+        {
+            StringRef Intern(const std::string& str)
+            {
+                auto it = offsets.find(str);
+                if (it == offsets.end())
+                {
+                    it = offsets.emplace(str, static_cast<uint32_t>(strings.size())).first;
+                    strings.insert(strings.end(), str.begin(), str.end());
+                }
+                return {it->second, static_cast<uint32_t>(str.size())};
+            }
+
+            std::unordered_map<std::string, uint32_t> offsets;
+            std::vector<char> strings;
+        };
+
+        template <class T>
+        static Table append(std::string& data, const std::vector<T>& records)
+        {
+            // Keeps every table 4 byte aligned
+            data.resize((data.size() + 3) & ~size_t(3), '\0');
+            Table table{static_cast<uint32_t>(data.size()), static_cast<uint32_t>(records.size())};
+            data.append(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(T));
+            return table;
+        }
+
+        const Header& header() const
+        {
+            return *reinterpret_cast<const Header*>(file_.Data());
+        }
+
+        template <class T>
+        T record(const Table& table, size_t i) const
+        {
+            T value;
+            std::memcpy(&value, file_.Data() + table.offset + i * sizeof(T), sizeof(T));
+            return value;
+        }
+
+        std::string_view string(const StringRef& ref) const
+        {
+            return {reinterpret_cast<const char*>(file_.Data()) + header().strings.offset +
+                        ref.offset,
+                    ref.size};
+        }
+
+        template <class T>
+        bool table_in_bounds(const Table& table) const
+        {
+            return table.offset % alignof(T) == 0 &&
+                   uint64_t(table.offset) + uint64_t(table.count) * sizeof(T) <= file_.Size();
+        }
+
+        bool string_in_bounds(const StringRef& ref) const
+        {
+            return uint64_t(ref.offset) + ref.size <= header().strings.count;
+        }
+
+        // Bounds checks every table and reference once, so the accessors don't have to. A
+        // truncated or foreign file is treated as missing
+        bool validate() const
+        {
+            if (file_.Size() < sizeof(Header))
+                return false;
+
+            const Header& h = header();
+            if (h.magic != magic || h.version != version)
+                return false;
+            if (!table_in_bounds<SystemRecord>(h.systems) ||
+                !table_in_bounds<uint32_t>(h.system_entries) ||
+                !table_in_bounds<EntryRecord>(h.entries) ||
+                !table_in_bounds<DownloadRecord>(h.downloads) ||
+                !table_in_bounds<FileRecord>(h.files) || !table_in_bounds<char>(h.strings))
+                return false;
+
+            for (uint32_t i = 0; i < h.systems.count; i++)
+            {
+                SystemRecord system = record<SystemRecord>(h.systems, i);
+                if (!string_in_bounds(system.name) ||
+                    uint64_t(system.first_entry) + system.entry_count > h.system_entries.count)
+                    return false;
+            }
+
+            for (uint32_t i = 0; i < h.system_entries.count; i++)
+            {
+                if (record<uint32_t>(h.system_entries, i) >= h.entries.count)
+                    return false;
+            }
+
+            for (uint32_t i = 0; i < h.entries.count; i++)
+            {
+                EntryRecord entry = record<EntryRecord>(h.entries, i);
+                if (!string_in_bounds(entry.core_name) || !string_in_bounds(entry.core_sub_name) ||
+                    !string_in_bounds(entry.versioning) ||
+                    !string_in_bounds(entry.versioning_url) ||
+                    uint64_t(entry.first_download) + entry.download_count > h.downloads.count)
+                    return false;
+            }
+
+            for (uint32_t i = 0; i < h.downloads.count; i++)
+            {
+                DownloadRecord download = record<DownloadRecord>(h.downloads, i);
+                if (!string_in_bounds(download.os) || !string_in_bounds(download.url))
+                    return false;
+            }
+
+            for (uint32_t i = 0; i < h.files.count; i++)
+            {
+                if (!string_in_bounds(record<FileRecord>(h.files, i).name))
+                    return false;
+            }
+            return true;
+        }
+
+        MappedFile file_;
+        bool valid_ = false;
+    };
+
+} // namespace hydra
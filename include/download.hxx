@@ -2,21 +2,27 @@
 
 #define CPPHTTPLIB_OPENSSL_SUPPORT
 #include "httplib.h"
+#include <filesystem>
+#include <fstream>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace hydra
 {
     using HydraBufferWrapper = std::vector<uint8_t>;
 
+    // Splits a url into scheme://host[:port] and the path that follows it
     inline std::pair<std::string, std::string> split_url(const std::string& url)
     {
-        std::regex path_regex("http[s]?://(.*?)(/.*)");
-        std::string host = "https://", query;
+        std::regex path_regex("(https?://[^/]+)(/.*)");
+        std::string host, query;
         std::smatch match;
         if (std::regex_search(url, match, path_regex) && match.size() == 3)
         {
-            host += match[1];
+            host = match[1];
             query = match[2];
         }
         else
@@ -27,6 +33,68 @@ namespace hydra
         return std::make_pair(host, query);
     }
 
+    // Cache validators of a previous response. Sending them back lets the server answer with a
+    // bodyless 304 when the resource didn't change
+    struct HttpValidators
+    {
+        std::string etag;
+        std::string last_modified;
+    };
+
+    enum class DownloadResult
+    {
+        Downloaded,
+        NotModified,
+        Failed,
+    };
+
+    // Idle keep-alive connections by scheme://host, so consecutive requests to a host skip the
+    // TCP and TLS handshakes. An httplib client runs one request at a time, so each request takes
+    // a client out of the pool and returns it when it's done
+    class ClientPool
+    {
+    public:
+        static ClientPool& Get()
+        {
+            static ClientPool pool;
+            return pool;
+        }
+
+        std::unique_ptr<httplib::Client> Acquire(const std::string& host)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                auto& idle = idle_[host];
+                if (!idle.empty())
+                {
+                    std::unique_ptr<httplib::Client> client = std::move(idle.back());
+                    idle.pop_back();
+                    return client;
+                }
+            }
+
+            auto client = std::make_unique<httplib::Client>(host);
+            client->set_keep_alive(true);
+            return client;
+        }
+
+        // Only for clients whose last request completed, a connection in an unknown state is
+        // dropped instead
+        void Release(const std::string& host, std::unique_ptr<httplib::Client> client)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto& idle = idle_[host];
+            if (idle.size() < max_idle_per_host)
+                idle.push_back(std::move(client));
+        }
+
+    private:
+        static constexpr size_t max_idle_per_host = 8;
+
+        std::mutex mutex_;
+        std::unordered_map<std::string, std::vector<std::unique_ptr<httplib::Client>>> idle_;
+    };
+
     struct Downloader
     {
         static HydraBufferWrapper Download(const std::string& url)
@@ -38,35 +106,304 @@ namespace hydra
         DownloadProgress(const std::string& url,
                          std::function<bool(uint64_t current, uint64_t total)> progress = nullptr)
         {
-            try
+            HydraBufferWrapper buffer;
+            if (DownloadIfModified(url, buffer, nullptr, progress) != DownloadResult::Downloaded)
+                return {};
+            return buffer;
+        }
+
+        // Sends the validators, if any, as If-None-Match and If-Modified-Since. On NotModified
+        // buffer is left untouched, on Downloaded it holds the body and validators are replaced
+        // with the ones of the new response
+        static DownloadResult
+        DownloadIfModified(const std::string& url, HydraBufferWrapper& buffer,
+                           HttpValidators* validators,
+                           std::function<bool(uint64_t current, uint64_t total)> progress = nullptr)
+        {
+            HydraBufferWrapper body;
+            auto begin = [&body](const httplib::Response&) {
+                body.clear();
+                return true;
+            };
+            auto content_receiver = [&body](const char* data, size_t size) {
+                body.insert(body.end(), data, data + size);
+                return true;
+            };
+            DownloadResult result =
+                request(url, {}, validators, begin, content_receiver, progress);
+            if (result == DownloadResult::Downloaded)
+                buffer = std::move(body);
+            return result;
+        }
+
+        // Streams the body into path as it arrives instead of holding it in memory, for anything
+        // bigger than a small json. path is truncated first and its contents are only complete
+        // when this returns true, otherwise it is removed
+        static bool DownloadToFile(const std::string& url, const std::filesystem::path& path,
+                                   std::function<bool(uint64_t current, uint64_t total)> progress =
+                                       nullptr)
+        {
+            return DownloadToFileIfModified(url, path, nullptr, progress) ==
+                   DownloadResult::Downloaded;
+        }
+
+        // Like DownloadToFile, but path isn't opened at all when the server answers 304
+        static DownloadResult
+        DownloadToFileIfModified(const std::string& url, const std::filesystem::path& path,
+                                 HttpValidators* validators,
+                                 std::function<bool(uint64_t current, uint64_t total)> progress =
+                                     nullptr)
+        {
+            std::ofstream file;
+            auto begin = [&file, &path](const httplib::Response&) {
+                file.open(path, std::ios::binary | std::ios::trunc);
+                if (!file.good())
+                {
+                    printf("Failed to open %s for writing\n", path.string().c_str());
+                    return false;
+                }
+                return true;
+            };
+            auto content_receiver = [&file](const char* data, size_t size) {
+                file.write(data, size);
+                return file.good();
+            };
+
+            DownloadResult result =
+                request(url, {}, validators, begin, content_receiver, progress);
+            if (file.is_open())
+            {
+                file.close();
+                if (result == DownloadResult::Downloaded && !file.good())
+                {
+                    printf("Failed to write %s\n", path.string().c_str());
+                    result = DownloadResult::Failed;
+                }
+            }
+
+            if (result == DownloadResult::Failed)
+            {
+                std::error_code error;
+                std::filesystem::remove(path, error);
+            }
+            return result;
+        }
+
+        // Downloads into path.part and renames it to path once it's complete. An interrupted
+        // transfer is left in place and continued by the next call with a Range request, If-Range
+        // makes the server send the whole file instead if it changed in the meantime
+        static bool DownloadToFileResumable(const std::string& url,
+                                            const std::filesystem::path& path,
+                                            std::function<bool(uint64_t current, uint64_t total)>
+                                                progress = nullptr)
+        {
+            std::filesystem::path part_path = path;
+            part_path += ".part";
+            std::filesystem::path validator_path = path;
+            validator_path += ".part.validator";
+
+            std::error_code error;
+            uint64_t offset = std::filesystem::file_size(part_path, error);
+            std::string validator;
+            std::ifstream validator_file(validator_path);
+            std::getline(validator_file, validator);
+            validator_file.close();
+            if (error || validator.empty())
+                offset = 0;
+
+            httplib::Headers headers;
+            if (offset > 0)
             {
-                auto [host, query] = split_url(url);
-                if (host.empty() || query.empty())
+                headers.emplace("Range", "bytes=" + std::to_string(offset) + "-");
+                headers.emplace("If-Range", validator);
+            }
+
+            std::ofstream file;
+            bool bad_range = false;
+            auto begin = [&](const httplib::Response& response) {
+                bool resumed = response.status == 206;
+                if (resumed)
+                {
+                    std::string expected = "bytes " + std::to_string(offset) + "-";
+                    if (response.get_header_value("Content-Range").rfind(expected, 0) != 0)
+                    {
+                        printf("Unexpected range when resuming %s\n", url.c_str());
+                        bad_range = true;
+                        return false;
+                    }
+                }
+                else
                 {
-                    return {};
+                    offset = 0;
+                    // Weak etags can't be used with If-Range
+                    std::string etag = response.get_header_value("ETag");
+                    std::ofstream(validator_path, std::ios::trunc)
+                        << (etag.empty() || etag.rfind("W/", 0) == 0
+                                ? response.get_header_value("Last-Modified")
+                                : etag);
                 }
 
-                httplib::Client client(host);
-                client.set_follow_location(true);
-                httplib::Result response =
-                    progress ? client.Get(query, progress) : client.Get(query);
-                printf("Finished: %s\n", url.c_str());
+                file.open(part_path,
+                          std::ios::binary | (resumed ? std::ios::app : std::ios::trunc));
+                if (!file.good())
+                {
+                    printf("Failed to open %s for writing\n", part_path.string().c_str());
+                    return false;
+                }
+                return true;
+            };
+            auto content_receiver = [&file](const char* data, size_t size) {
+                file.write(data, size);
+                return file.good();
+            };
+            auto offset_progress = [&offset, &progress](uint64_t current, uint64_t total) {
+                return progress(offset + current, offset + total);
+            };
 
-                if (!response)
+            int status = 0;
+            DownloadResult result =
+                request(url, headers, nullptr, begin, content_receiver,
+                        progress ? offset_progress : decltype(progress)(), &status);
+            if (file.is_open())
+            {
+                file.close();
+                if (result == DownloadResult::Downloaded && !file.good())
                 {
-                    printf("Null response when downloading %s\n", url.c_str());
+                    printf("Failed to write %s\n", part_path.string().c_str());
+                    result = DownloadResult::Failed;
                 }
-                else if (response->status != 200)
+            }
+
+            if (result == DownloadResult::Downloaded)
+            {
+                std::filesystem::remove(validator_path, error);
+                std::filesystem::rename(part_path, path, error);
+                if (error)
                 {
-                    printf("Failed to download %s: %d\n", url.c_str(), response->status);
+                    printf("Failed to rename %s: %s\n", part_path.string().c_str(),
+                           error.message().c_str());
+                    return false;
                 }
+                return true;
+            }
+
+            // A part the server won't continue from is useless, anything else is kept for the
+            // next attempt
+            if (status == 416 || bad_range)
+            {
+                std::filesystem::remove(part_path, error);
+                std::filesystem::remove(validator_path, error);
+                if (status == 416 && offset > 0)
+                    return DownloadToFileResumable(url, path, progress);
+            }
+            return false;
+        }
+
+    private:
+        // begin is called with the final response once it turned out to be a 200, or a 206 if a
+        // Range was requested, before any of its body is passed to content_receiver. Connections
+        // come from the ClientPool
+        static DownloadResult request(const std::string& url, httplib::Headers headers,
+                                      HttpValidators* validators,
+                                      std::function<bool(const httplib::Response&)> begin,
+                                      httplib::ContentReceiver content_receiver,
+                                      std::function<bool(uint64_t, uint64_t)> progress,
+                                      int* final_status = nullptr)
+        {
+            try
+            {
+                if (validators && !validators->etag.empty())
+                    headers.emplace("If-None-Match", validators->etag);
+                if (validators && !validators->last_modified.empty())
+                    headers.emplace("If-Modified-Since", validators->last_modified);
+                bool ranged = headers.find("Range") != headers.end();
 
-                return {response->body.begin(), response->body.end()};
+                // httplib treats a 304 as a redirect without a location and fails the request
+                // when it follows redirects itself, so they are followed here instead
+                std::string current_url = url;
+                for (int redirects = 0; redirects <= max_redirects; redirects++)
+                {
+                    auto [host, query] = split_url(current_url);
+                    if (host.empty() || query.empty())
+                    {
+                        return DownloadResult::Failed;
+                    }
+
+                    int status = 0;
+                    bool began = false;
+                    std::string location;
+                    HttpValidators new_validators;
+                    // The bodies of other responses are dropped. They are read to the end if
+                    // their length is known, to keep the connection. Cancelling makes httplib
+                    // close it, but reading a body without a length waits for the server to
+                    // close it, which a 304 on a kept alive connection never does
+                    auto response_handler = [&](const httplib::Response& response) {
+                        status = response.status;
+                        if (status != 200 && !(status == 206 && ranged))
+                        {
+                            location = response.get_header_value("Location");
+                            return status != 304 && (response.has_header("Content-Length") ||
+                                                     response.get_header_value(
+                                                         "Transfer-Encoding") == "chunked");
+                        }
+                        new_validators.etag = response.get_header_value("ETag");
+                        new_validators.last_modified = response.get_header_value("Last-Modified");
+                        began = true;
+                        return begin(response);
+                    };
+                    auto receiver = [&](const char* data, size_t size) {
+                        return !began || content_receiver(data, size);
+                    };
+
+                    std::unique_ptr<httplib::Client> client = ClientPool::Get().Acquire(host);
+                    httplib::Result response =
+                        progress ? client->Get(query, headers, response_handler, receiver,
+                                               [&](uint64_t current, uint64_t total) {
+                                                   return !began || progress(current, total);
+                                               })
+                                 : client->Get(query, headers, response_handler, receiver);
+                    if (final_status)
+                        *final_status = status;
+                    if (response)
+                        ClientPool::Get().Release(host, std::move(client));
+
+                    if (status == 304)
+                    {
+                        printf("Not modified: %s\n", url.c_str());
+                        return DownloadResult::NotModified;
+                    }
+                    else if (status > 300 && status < 400 && !location.empty())
+                    {
+                        current_url = location.front() == '/' ? host + location : location;
+                        continue;
+                    }
+                    else if (status != 0 && status != 200 && !(status == 206 && ranged))
+                    {
+                        printf("Failed to download %s: %d\n", url.c_str(), status);
+                        return DownloadResult::Failed;
+                    }
+                    else if (!response)
+                    {
+                        printf("Failed to download %s: %s\n", url.c_str(),
+                               httplib::to_string(response.error()).c_str());
+                        return DownloadResult::Failed;
+                    }
+
+                    printf("Finished: %s\n", url.c_str());
+                    if (validators)
+                        *validators = std::move(new_validators);
+                    return DownloadResult::Downloaded;
+                }
+
+                printf("Too many redirects when downloading %s\n", url.c_str());
+                return DownloadResult::Failed;
             } catch (...)
             {
                 printf("Failed while trying to download %s\n", url.c_str());
-                return {};
+                return DownloadResult::Failed;
             }
         }
+
+        static constexpr int max_redirects = 10;
     };
 } // namespace hydra
\ No newline at end of file
@@ -0,0 +1,126 @@
+#pragma once
+
+#include "settings.hxx"
+#include "update.hxx"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+namespace hydra
+{
+
+    // Queue of core downloads, run on at most a fixed number of threads that are started as the
+    // queue grows. Requests to the same host share keep-alive connections through the
+    // ClientPool, and an interrupted download continues where it stopped the next time it's
+    // queued. Destroying the manager drops what's still queued and cancels what's running
+    class DownloadManager
+    {
+    public:
+        // Both are called on a download thread
+        using Progress = std::function<void(uint64_t current, uint64_t total)>;
+        using Finished = std::function<void(bool installed)>;
+
+        DownloadManager(int max_concurrent = hydra::setting::max_downloads.Get())
+            : max_concurrent_(std::max(1, max_concurrent))
+        {
+        }
+
+        ~DownloadManager()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stopping_ = true;
+                queue_.clear();
+            }
+            cv_.notify_all();
+            for (std::thread& thread : threads_)
+                thread.join();
+        }
+
+        // Returns false if the url is already queued or downloading
+        bool Enqueue(const std::string& url, Progress progress, Finished finished)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (stopping_ || !pending_.insert(url).second)
+                    return false;
+
+                queue_.push_back({url, std::move(progress), std::move(finished)});
+                // A thread that was just started counts as idle, it will pick up a job as soon
+                // as it runs
+                if (queue_.size() > idle_ && threads_.size() < static_cast<size_t>(max_concurrent_))
+                {
+                    idle_++;
+                    threads_.emplace_back(&DownloadManager::worker, this);
+                }
+            }
+            cv_.notify_one();
+            return true;
+        }
+
+        bool IsPending(const std::string& url)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return pending_.find(url) != pending_.end();
+        }
+
+    private:
+        struct Job
+        {
+            std::string url;
+            Progress progress;
+            Finished finished;
+        };
+
+        void worker()
+        {
+            while (true)
+            {
+                Job job;
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    cv_.wait(lock, [this]() { return stopping_ || !queue_.empty(); });
+                    if (stopping_)
+                        return;
+                    idle_--;
+                    job = std::move(queue_.front());
+                    queue_.pop_front();
+                }
+
+                bool installed = Updater::DownloadCore(
+                    job.url, [this, &job](uint64_t current, uint64_t total) {
+                        if (job.progress)
+                            job.progress(current, total);
+                        // Stops the transfer, what was downloaded so far is kept for next time
+                        return !stopping_;
+                    });
+
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    pending_.erase(job.url);
+                    idle_++;
+                }
+                if (job.finished)
+                    job.finished(installed);
+            }
+        }
+
+        const int max_concurrent_;
+        std::mutex mutex_;
+        std::condition_variable cv_;
+        std::deque<Job> queue_;
+        std::unordered_set<std::string> pending_;
+        std::vector<std::thread> threads_;
+        // Threads that aren't running a job, started ones included
+        size_t idle_ = 0;
+        std::atomic_bool stopping_ = false;
+    };
+
+} // namespace hydra
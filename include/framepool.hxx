@@ -0,0 +1,57 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+namespace hydra
+{
+
+    // Lock-free triple buffer for handing frames from one producer thread to one consumer thread.
+    // The producer always has a slot to write into, the consumer always has the newest finished
+    // frame, and the third slot is swapped between them. Frames only move by swapping indices,
+    // and slot storage is only reallocated when a frame is bigger than anything seen before
+    class FramePool
+    {
+    public:
+        struct Slot
+        {
+            std::vector<uint8_t> data;
+            uint32_t width = 0;
+            uint32_t height = 0;
+        };
+
+        // Producer side, the slot the next frame should be written into
+        Slot& WriteSlot()
+        {
+            return slots_[write_];
+        }
+
+        // Producer side, makes the write slot the newest frame and takes back the spare slot
+        void Publish()
+        {
+            write_ = shared_.exchange(write_ | fresh_bit, std::memory_order_acq_rel) & index_mask;
+        }
+
+        // Consumer side, returns the newest frame or nullptr if nothing was published since the
+        // last call. The slot stays valid until the next successful Acquire
+        Slot* Acquire()
+        {
+            if (!(shared_.load(std::memory_order_relaxed) & fresh_bit))
+                return nullptr;
+            read_ = shared_.exchange(read_, std::memory_order_acq_rel) & index_mask;
+            return &slots_[read_];
+        }
+
+    private:
+        static constexpr uint8_t index_mask = 0b11;
+        static constexpr uint8_t fresh_bit = 0b100;
+
+        std::array<Slot, 3> slots_;
+        uint8_t write_ = 0;
+        std::atomic<uint8_t> shared_ = 1;
+        uint8_t read_ = 2;
+    };
+
+} // namespace hydra
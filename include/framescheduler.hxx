@@ -0,0 +1,111 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+namespace hydra
+{
+    // What drives the emulator thread
+    enum class SyncMode
+    {
+        // Wall clock pacing at the core's frame rate
+        Video,
+        // Run a frame whenever the audio buffer drops below the latency target, so the audio
+        // device clock drives emulation
+        Audio,
+        // Unthrottled
+        FreeRun,
+    };
+
+    inline SyncMode sync_mode_from_string(const std::string& str)
+    {
+        if (str == "audio")
+            return SyncMode::Audio;
+        else if (str == "free")
+            return SyncMode::FreeRun;
+        return SyncMode::Video;
+    }
+
+    // What to do when the emulator thread falls behind the wall clock
+    enum class LagPolicy
+    {
+        // Emulate the missed frames back to back and only present the last one
+        CatchUp,
+        // Forget the missed frames and resync the deadline, emulation slows down instead
+        Skip,
+    };
+
+    // Paces frames against absolute deadlines so that rounding errors don't accumulate.
+    // Waiting is done by sleeping until shortly before the deadline and then spinning for
+    // the remainder, since sleep granularity on most systems is far worse than a frame needs
+    class FrameScheduler
+    {
+    public:
+        using clock = std::chrono::steady_clock;
+
+        void Reset(double fps, LagPolicy policy = LagPolicy::CatchUp)
+        {
+            if (fps <= 0)
+                fps = 60;
+            period_ = std::chrono::duration_cast<clock::duration>(
+                std::chrono::duration<double>(1.0 / fps));
+            policy_ = policy;
+            next_deadline_ = clock::now() + period_;
+        }
+
+        // Blocks until the next frame is due and returns how many frames should be emulated
+        // before presenting. This is more than one only when catching up
+        uint32_t Wait()
+        {
+            clock::time_point now = clock::now();
+            if (now < next_deadline_)
+            {
+                wait_until(next_deadline_);
+                next_deadline_ += period_;
+                return 1;
+            }
+
+            uint64_t behind = (now - next_deadline_) / period_;
+            if (policy_ == LagPolicy::Skip || behind >= max_lag_frames)
+            {
+                // Either we don't care about the missed frames or we are so far behind
+                // (breakpoint, suspended laptop, etc.) that catching up would look worse
+                next_deadline_ = now + period_;
+                return 1;
+            }
+
+            next_deadline_ += period_ * (behind + 1);
+            return behind + 1;
+        }
+
+        clock::duration GetPeriod() const
+        {
+            return period_;
+        }
+
+        static constexpr uint64_t max_lag_frames = 8;
+
+    private:
+        static constexpr auto spin_threshold = std::chrono::microseconds(1500);
+
+        static void wait_until(clock::time_point deadline)
+        {
+            clock::time_point now = clock::now();
+            if (deadline - now > spin_threshold)
+            {
+                std::this_thread::sleep_for(deadline - now - spin_threshold);
+            }
+
+            while (clock::now() < deadline)
+            {
+                std::this_thread::yield();
+            }
+        }
+
+        clock::duration period_{};
+        clock::time_point next_deadline_{};
+        LagPolicy policy_ = LagPolicy::CatchUp;
+    };
+} // namespace hydra
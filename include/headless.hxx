@@ -0,0 +1,5 @@
+#pragma once
+
+// Runs a core without a window or audio device as fast as it can go and prints timing statistics.
+// Runs for the given amount of frames, or seconds if that is non-zero
+int main_headless(const char* rom_path, const char* core_name, int frames, float seconds);
@@ -13,6 +13,11 @@ inline void log_info(const char* message)
     printf("[INFO] %s\n", message);
 }
 
+inline void log_debug(const char* message)
+{
+    printf("[DEBUG] %s\n", message);
+}
+
 // TODO: This should not exit, instead print message and set emulator to null
 inline void log_fatal(const char* message)
 {
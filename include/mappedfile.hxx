@@ -0,0 +1,105 @@
+#pragma once
+
+#include "hsystem.hxx"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#if defined(HYDRA_LINUX) || defined(HYDRA_MACOS) || defined(HYDRA_ANDROID)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#elif defined(HYDRA_WINDOWS)
+#include <windows.h>
+#endif
+
+namespace hydra
+{
+
+    // Read only view of a whole file. The pages are only read from disk when touched, so nothing
+    // is copied up front. Check Valid() before using the data, mapping fails for empty files and
+    // on platforms without a mapping API
+    class MappedFile
+    {
+    public:
+        MappedFile(const std::filesystem::path& path)
+        {
+#if defined(HYDRA_LINUX) || defined(HYDRA_MACOS) || defined(HYDRA_ANDROID)
+            int fd = open(path.c_str(), O_RDONLY);
+            if (fd == -1)
+                return;
+
+            struct stat st;
+            if (fstat(fd, &st) == 0 && st.st_size > 0)
+            {
+                void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (data != MAP_FAILED)
+                {
+                    data_ = static_cast<const uint8_t*>(data);
+                    size_ = st.st_size;
+                    // Hashing reads front to back, let the kernel read ahead aggressively
+                    madvise(data, size_, MADV_SEQUENTIAL);
+                }
+            }
+            // The mapping keeps its own reference to the file
+            close(fd);
+#elif defined(HYDRA_WINDOWS)
+            HANDLE file = CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ,
+                                      nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+            if (file == INVALID_HANDLE_VALUE)
+                return;
+
+            LARGE_INTEGER size;
+            if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+            {
+                HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+                if (mapping)
+                {
+                    void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+                    if (data)
+                    {
+                        data_ = static_cast<const uint8_t*>(data);
+                        size_ = size.QuadPart;
+                    }
+                    CloseHandle(mapping);
+                }
+            }
+            CloseHandle(file);
+#endif
+        }
+
+        ~MappedFile()
+        {
+            if (!data_)
+                return;
+#if defined(HYDRA_LINUX) || defined(HYDRA_MACOS) || defined(HYDRA_ANDROID)
+            munmap(const_cast<uint8_t*>(data_), size_);
+#elif defined(HYDRA_WINDOWS)
+            UnmapViewOfFile(data_);
+#endif
+        }
+
+        bool Valid() const
+        {
+            return data_ != nullptr;
+        }
+
+        const uint8_t* Data() const
+        {
+            return data_;
+        }
+
+        size_t Size() const
+        {
+            return size_;
+        }
+
+    private:
+        const uint8_t* data_ = nullptr;
+        size_t size_ = 0;
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+    };
+
+} // namespace hydra
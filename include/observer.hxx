@@ -3,15 +3,18 @@
 #pragma once
 
 #include <algorithm>
+#include <mutex>
 #include <vector>
 
 namespace hydra
 {
     struct Subject;
 
+    // Derived classes attach themselves to the subject at the end of their constructor, attaching
+    // from here would let another thread update an observer that is still being constructed
     struct Observer
     {
-        explicit Observer(Subject* subject);
+        explicit Observer(Subject* subject) : subject_(subject) {}
 
         virtual ~Observer() = default;
         virtual void update() = 0;
@@ -23,33 +26,39 @@ namespace hydra
         Subject* subject_;
     };
 
+    // Can be used from any thread. The lock is held while observers are updated, so once detach
+    // returns the observer is never updated again and can be destroyed. Observers may attach and
+    // detach from update, but must not wait on a thread that does so on the same subject
     struct Subject
     {
         void notify()
         {
-            for (auto& observer : observers_)
+            std::lock_guard<std::recursive_mutex> lock(mutex_);
+            // Iterates a copy, update may detach observers, including ones that are still to be
+            // updated
+            std::vector<Observer*> observers = observers_;
+            for (Observer* observer : observers)
             {
-                observer->update();
+                if (std::find(observers_.begin(), observers_.end(), observer) != observers_.end())
+                    observer->update();
             }
         }
 
         void attach(Observer* observer)
         {
+            std::lock_guard<std::recursive_mutex> lock(mutex_);
             observers_.push_back(observer);
         }
 
         void detach(Observer* observer)
         {
+            std::lock_guard<std::recursive_mutex> lock(mutex_);
             observers_.erase(std::remove(observers_.begin(), observers_.end(), observer),
                              observers_.end());
         }
 
     private:
+        std::recursive_mutex mutex_;
         std::vector<Observer*> observers_;
     };
-
-    inline Observer::Observer(Subject* subject) : subject_(subject)
-    {
-        subject_->attach(this);
-    }
 } // namespace hydra
\ No newline at end of file
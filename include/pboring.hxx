@@ -0,0 +1,107 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+
+// Must be included after an OpenGL header, the types and constants come from there
+
+namespace hydra
+{
+
+    // Uploads RGBA8 frames to a texture through a ring of pixel unpack buffers, so that the copy
+    // to the texture happens asynchronously. Each buffer is fenced so it isn't overwritten while
+    // still in use. GL is what the OpenGL functions are called through, QOpenGLExtraFunctions or
+    // anything with the same member functions. Needs a current context for everything but the
+    // constructor
+    template <class GL>
+    class PboRing
+    {
+    public:
+        explicit PboRing(GL& gl) : gl_(gl) {}
+
+        ~PboRing()
+        {
+            Destroy();
+        }
+
+        // Drops the old buffers, each new one holds size bytes
+        void Create(std::size_t size)
+        {
+            Destroy();
+            gl_.glGenBuffers(count, pbos_.data());
+            for (GLuint pbo : pbos_)
+            {
+                gl_.glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+                gl_.glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+            }
+            gl_.glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            size_ = size;
+            index_ = 0;
+        }
+
+        void Destroy()
+        {
+            for (GLsync& fence : fences_)
+            {
+                if (fence)
+                    gl_.glDeleteSync(fence);
+                fence = nullptr;
+            }
+            if (pbos_[0] != 0)
+                gl_.glDeleteBuffers(count, pbos_.data());
+            pbos_.fill(0);
+            size_ = 0;
+        }
+
+        // The whole texture is replaced, width * height * 4 must match the size the ring was
+        // created with. Returns false if nothing was uploaded
+        bool Upload(GLuint texture, const void* data, int width, int height)
+        {
+            gl_.glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos_[index_]);
+            GLsync& fence = fences_[index_];
+            if (fence)
+            {
+                // Practically never waits, the upload from this buffer was two frames ago
+                gl_.glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+                gl_.glDeleteSync(fence);
+                fence = nullptr;
+            }
+
+            void* mapped = gl_.glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size_,
+                                                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT |
+                                                    GL_MAP_UNSYNCHRONIZED_BIT);
+            if (mapped)
+            {
+                std::memcpy(mapped, data, size_);
+                gl_.glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+                gl_.glBindTexture(GL_TEXTURE_2D, texture);
+                gl_.glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGBA,
+                                    GL_UNSIGNED_BYTE, nullptr);
+                gl_.glBindTexture(GL_TEXTURE_2D, 0);
+                fence = gl_.glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            }
+            else
+            {
+                printf("Failed to map pixel unpack buffer\n");
+            }
+            gl_.glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            index_ = (index_ + 1) % count;
+            return mapped != nullptr;
+        }
+
+    private:
+        PboRing(const PboRing&) = delete;
+        PboRing& operator=(const PboRing&) = delete;
+
+        static constexpr std::size_t count = 3;
+
+        GL& gl_;
+        std::array<GLuint, count> pbos_{};
+        std::array<GLsync, count> fences_{};
+        std::size_t index_ = 0;
+        std::size_t size_ = 0;
+    };
+
+} // namespace hydra
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Conversions between the pixel layouts the frontend deals with. Rows are tightly packed and
+// pixels are 4 bytes unless noted otherwise. Each function uses the fastest implementation the
+// running CPU supports (SSE2, SSSE3, AVX2 or NEON), picked once on first use, and falls back to
+// plain loops everywhere else
+namespace hydra::pixel
+{
+    // Byte i of every output pixel is byte order[i] of the input pixel
+    using Swizzle = std::array<uint8_t, 4>;
+    // ABGR <-> RGBA, also the byte order of 0xRRGGBBAA words on little endian machines
+    constexpr Swizzle swizzle_reverse = {3, 2, 1, 0};
+    // RGBA <-> BGRA
+    constexpr Swizzle swizzle_rb = {2, 1, 0, 3};
+
+    // dst and src may be the same buffer, but must not overlap otherwise
+    void swizzle(uint8_t* dst, const uint8_t* src, size_t pixels, Swizzle order);
+
+    inline void rgba_to_bgra(uint8_t* dst, const uint8_t* src, size_t pixels)
+    {
+        swizzle(dst, src, pixels, swizzle_rb);
+    }
+
+    // Overwrites the fourth byte of every pixel
+    void fill_alpha(uint8_t* data, size_t pixels, uint8_t alpha = 0xFF);
+
+    // Reverses the order of the rows, dst and src may be the same buffer
+    void flip_vertical(uint8_t* dst, const uint8_t* src, size_t row_bytes, size_t rows);
+
+    // Alpha is dropped on the way to RGB565 and set to opaque on the way back
+    void rgba_to_rgb565(uint16_t* dst, const uint8_t* src, size_t pixels);
+    void rgb565_to_rgba(uint8_t* dst, const uint16_t* src, size_t pixels);
+
+    // Nearest neighbour upscale by factor in both directions, dst must have room for
+    // width * height * factor * factor pixels
+    void scale_integer(uint8_t* dst, const uint8_t* src, size_t width, size_t height,
+                       size_t factor);
+
+    // Which implementation was picked, for logging
+    const char* backend_name();
+
+    // The implementations this CPU can run, scalar first and the default last
+    std::vector<const char*> backend_names();
+    // Switches every function to another of backend_names, for tests and benchmarks. Not safe
+    // while another thread is converting. Returns false if the CPU can't run it
+    bool set_backend(std::string_view name);
+} // namespace hydra::pixel
@@ -0,0 +1,265 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fmt/format.h>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#define HYDRA_PROFILE_CONCAT_IMPL(a, b) a##b
+#define HYDRA_PROFILE_CONCAT(a, b) HYDRA_PROFILE_CONCAT_IMPL(a, b)
+// Times the enclosing scope. name must be a string literal, only the pointer is recorded
+#define HYDRA_PROFILE_SCOPE(name)                                                                  \
+    hydra::ProfileScope HYDRA_PROFILE_CONCAT(hydra_profile_scope_, __LINE__)(name)
+
+namespace hydra
+{
+
+    struct ProfileEvent
+    {
+        const char* name = nullptr;
+        uint64_t start_ns = 0;
+        uint64_t duration_ns = 0;
+    };
+
+    // Fixed size per-thread event log. Only the owning thread writes and it never waits for
+    // readers, old events are simply overwritten. Fields are relaxed atomics so readers on other
+    // threads can take a snapshot at any time, entries that were overwritten while copying are
+    // detected through the head index and dropped
+    class ProfileRing
+    {
+    public:
+        static constexpr size_t event_count = 8192;
+
+        ProfileRing(uint32_t id) : id_(id) {}
+
+        void Push(const char* name, uint64_t start_ns, uint64_t duration_ns)
+        {
+            uint64_t head = head_.load(std::memory_order_relaxed);
+            // A reader that sees any of the stores below also sees the head stored by the last
+            // push, see Snapshot
+            std::atomic_thread_fence(std::memory_order_release);
+            Entry& entry = entries_[head & mask];
+            entry.name.store(name, std::memory_order_relaxed);
+            entry.start_ns.store(start_ns, std::memory_order_relaxed);
+            entry.duration_ns.store(duration_ns, std::memory_order_relaxed);
+            head_.store(head + 1, std::memory_order_release);
+        }
+
+        // Appends the events that started at or after since_ns, oldest first
+        void Snapshot(std::vector<ProfileEvent>& out, uint64_t since_ns = 0) const
+        {
+            uint64_t head = head_.load(std::memory_order_acquire);
+            uint64_t first = head > event_count ? head - event_count : 0;
+            size_t old_size = out.size();
+            for (uint64_t i = first; i < head; i++)
+            {
+                const Entry& entry = entries_[i & mask];
+                ProfileEvent event;
+                event.name = entry.name.load(std::memory_order_relaxed);
+                event.start_ns = entry.start_ns.load(std::memory_order_relaxed);
+                event.duration_ns = entry.duration_ns.load(std::memory_order_relaxed);
+                out.push_back(event);
+            }
+
+            // Anything below the new head minus the capacity may have been overwritten mid-copy.
+            // So may the slot at the new head itself, the writer fills it before publishing the
+            // head after it, and that slot is also the one at new_head - event_count
+            std::atomic_thread_fence(std::memory_order_acquire);
+            uint64_t new_head = head_.load(std::memory_order_relaxed);
+            uint64_t valid = new_head + 1 > event_count ? new_head + 1 - event_count : 0;
+            size_t torn = valid > first ? std::min<uint64_t>(valid - first, head - first) : 0;
+            out.erase(out.begin() + old_size, out.begin() + old_size + torn);
+            out.erase(std::remove_if(out.begin() + old_size, out.end(),
+                                     [since_ns](const ProfileEvent& event) {
+                                         return event.start_ns < since_ns;
+                                     }),
+                      out.end());
+        }
+
+    private:
+        static constexpr uint64_t mask = event_count - 1;
+        static_assert((event_count & mask) == 0, "event_count must be a power of two");
+
+        struct Entry
+        {
+            std::atomic<const char*> name = nullptr;
+            std::atomic<uint64_t> start_ns = 0;
+            std::atomic<uint64_t> duration_ns = 0;
+        };
+
+        std::array<Entry, event_count> entries_;
+        std::atomic<uint64_t> head_ = 0;
+        uint32_t id_;
+        std::string name_;
+
+        friend class Profiler;
+    };
+
+    struct ProfileStats
+    {
+        const char* name = nullptr;
+        uint64_t count = 0;
+        uint64_t total_ns = 0;
+        uint64_t max_ns = 0;
+    };
+
+    // Process wide registry of the per-thread rings. Recording is off by default, in which case a
+    // profile scope costs one relaxed load
+    class Profiler
+    {
+    public:
+        static bool Enabled()
+        {
+            return enabled_.load(std::memory_order_relaxed);
+        }
+
+        static void SetEnabled(bool enabled)
+        {
+            enabled_.store(enabled, std::memory_order_relaxed);
+        }
+
+        static uint64_t Now()
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                       std::chrono::steady_clock::now() - epoch_)
+                .count();
+        }
+
+        static void Record(const char* name, uint64_t start_ns, uint64_t duration_ns)
+        {
+            thread_ring().Push(name, start_ns, duration_ns);
+        }
+
+        // Shown in exported traces instead of the thread number
+        static void SetThreadName(const std::string& name)
+        {
+            ProfileRing& ring = thread_ring();
+            std::unique_lock<std::mutex> lock(mutex_);
+            ring.name_ = name;
+        }
+
+        // Per scope name totals over the events that started in the last window_ns
+        static std::vector<ProfileStats> Summarize(uint64_t window_ns)
+        {
+            uint64_t now = Now();
+            uint64_t since = now > window_ns ? now - window_ns : 0;
+            std::vector<ProfileEvent> events;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                for (const auto& ring : rings_)
+                    ring->Snapshot(events, since);
+            }
+
+            std::unordered_map<const char*, ProfileStats> stats;
+            for (const ProfileEvent& event : events)
+            {
+                ProfileStats& stat = stats[event.name];
+                stat.name = event.name;
+                stat.count++;
+                stat.total_ns += event.duration_ns;
+                stat.max_ns = std::max(stat.max_ns, event.duration_ns);
+            }
+
+            std::vector<ProfileStats> ret;
+            ret.reserve(stats.size());
+            for (const auto& [_, stat] : stats)
+                ret.push_back(stat);
+            std::sort(ret.begin(), ret.end(), [](const ProfileStats& a, const ProfileStats& b) {
+                return std::string_view(a.name) < std::string_view(b.name);
+            });
+            return ret;
+        }
+
+        // Everything still in the rings in the chrome://tracing / Perfetto trace event format
+        static std::string ExportChromeTrace()
+        {
+            std::string out = "{\"traceEvents\":[";
+            bool first = true;
+            auto append = [&out, &first](const std::string& event) {
+                if (!first)
+                    out += ",\n";
+                out += event;
+                first = false;
+            };
+
+            std::unique_lock<std::mutex> lock(mutex_);
+            std::vector<ProfileEvent> events;
+            for (const auto& ring : rings_)
+            {
+                std::string name =
+                    ring->name_.empty() ? fmt::format("Thread {}", ring->id_) : ring->name_;
+                append(fmt::format("{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":{},"
+                                   "\"args\":{{\"name\":\"{}\"}}}}",
+                                   ring->id_, name));
+
+                events.clear();
+                ring->Snapshot(events);
+                for (const ProfileEvent& event : events)
+                {
+                    // Microseconds with fractional part, that's what the format expects
+                    append(fmt::format("{{\"name\":\"{}\",\"ph\":\"X\",\"pid\":1,\"tid\":{},"
+                                       "\"ts\":{:.3f},\"dur\":{:.3f}}}",
+                                       event.name, ring->id_, event.start_ns / 1000.0,
+                                       event.duration_ns / 1000.0));
+                }
+            }
+            out += "],\"displayTimeUnit\":\"ms\"}\n";
+            return out;
+        }
+
+    private:
+        static ProfileRing& thread_ring()
+        {
+            // The registry owns the rings so events survive the thread exiting
+            thread_local ProfileRing* ring = []() {
+                std::unique_lock<std::mutex> lock(mutex_);
+                rings_.push_back(std::make_unique<ProfileRing>(rings_.size() + 1));
+                return rings_.back().get();
+            }();
+            return *ring;
+        }
+
+        inline static std::atomic_bool enabled_ = false;
+        inline static const std::chrono::steady_clock::time_point epoch_ =
+            std::chrono::steady_clock::now();
+        inline static std::mutex mutex_;
+        inline static std::vector<std::unique_ptr<ProfileRing>> rings_;
+    };
+
+    class ProfileScope
+    {
+    public:
+        ProfileScope(const char* name)
+        {
+            if (Profiler::Enabled()) [[unlikely]]
+            {
+                name_ = name;
+                start_ns_ = Profiler::Now();
+            }
+        }
+
+        ~ProfileScope()
+        {
+            if (name_) [[unlikely]]
+            {
+                Profiler::Record(name_, start_ns_, Profiler::Now() - start_ns_);
+            }
+        }
+
+    private:
+        const char* name_ = nullptr;
+        uint64_t start_ns_ = 0;
+
+        ProfileScope(const ProfileScope&) = delete;
+        ProfileScope& operator=(const ProfileScope&) = delete;
+    };
+
+} // namespace hydra
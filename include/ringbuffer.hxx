@@ -1,14 +1,24 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 
 namespace hydra
 {
 
+    // Wait-free single producer single consumer ring buffer. write() must only ever be called from
+    // one thread and read() from one other thread. The indices grow monotonically and are only
+    // masked when accessing the buffer, so the whole capacity is usable and head - tail is always
+    // the fill level
     template <std::size_t count>
     class ringbuffer
     {
+        static_assert(count != 0 && (count & (count - 1)) == 0,
+                      "ringbuffer size must be a power of two");
+
     public:
         ringbuffer()
         {
@@ -20,51 +30,124 @@ namespace hydra
             delete[] buffer_;
         }
 
-        ringbuffer(ringbuffer&&) = default;
-        ringbuffer& operator=(ringbuffer&&) = default;
-
-        void write(void* in, std::size_t size)
+        // Returns how many bytes were written, anything that doesn't fit is dropped and counted as
+        // an overrun
+        std::size_t write(const void* in, std::size_t size)
         {
-            uint8_t* in8 = static_cast<uint8_t*>(in);
-            for (std::size_t i = 0; i < size; i++)
+            const uint8_t* in8 = static_cast<const uint8_t*>(in);
+            std::size_t head = head_.load(std::memory_order_relaxed);
+            std::size_t tail = tail_.load(std::memory_order_acquire);
+            std::size_t free = count - (head - tail);
+            if (size > free)
             {
-                buffer_[head_] = in8[i];
-                head_ = (head_ + 1) % count;
+                overruns_.fetch_add(1, std::memory_order_relaxed);
+                size = free;
             }
+
+            std::size_t offset = head & mask;
+            std::size_t first = std::min(size, count - offset);
+            std::memcpy(buffer_ + offset, in8, first);
+            std::memcpy(buffer_, in8 + first, size - first);
+            head_.store(head + size, std::memory_order_release);
+            return size;
         }
 
-        void read(void* out, std::size_t size)
+        // Returns how many bytes were read, if less than size was available it is counted as an
+        // underrun and the rest of out is left untouched
+        std::size_t read(void* out, std::size_t size)
         {
             uint8_t* out8 = static_cast<uint8_t*>(out);
-            for (std::size_t i = 0; i < size; i++)
+            std::size_t tail = tail_.load(std::memory_order_relaxed);
+            // A clear() that the consumer hasn't seen yet, skips up to where the head was then.
+            // Taken before loading the head, so the head loaded below is never behind it
+            std::size_t discard = discard_.exchange(0, std::memory_order_acquire);
+            if (discard != 0 && static_cast<std::ptrdiff_t>(discard - 1 - tail) > 0)
+                tail = discard - 1;
+            std::size_t head = head_.load(std::memory_order_acquire);
+            std::size_t available = head - tail;
+            if (size > available)
             {
-                out8[i] = buffer_[tail_];
-                tail_ = (tail_ + 1) % count;
+                underruns_.fetch_add(1, std::memory_order_relaxed);
+                size = available;
             }
+
+            std::size_t offset = tail & mask;
+            std::size_t first = std::min(size, count - offset);
+            std::memcpy(out8, buffer_ + offset, first);
+            std::memcpy(out8 + first, buffer_, size - first);
+            tail_.store(tail + size, std::memory_order_release);
+            return size;
+        }
+
+        // Like read() but always fills all of out, padding with zeroes on an underrun. Zero is
+        // silence for both signed integer and float samples
+        std::size_t read_padded(void* out, std::size_t size)
+        {
+            std::size_t read = this->read(out, size);
+            std::memset(static_cast<uint8_t*>(out) + read, 0, size - read);
+            return read;
         }
 
         std::size_t size() const
         {
-            return (head_ - tail_ + count) % count;
+            std::size_t tail = tail_.load(std::memory_order_acquire);
+            std::size_t head = head_.load(std::memory_order_acquire);
+            return head - tail;
+        }
+
+        static constexpr std::size_t capacity()
+        {
+            return count;
         }
 
         bool empty() const
         {
-            return head_ == tail_;
+            return size() == 0;
         }
 
+        // Discards everything that is currently readable. tail_ belongs to the consumer, so this
+        // only records how far to skip and the next read() does the skipping. Can be called from
+        // any thread but the consumer, the space is only freed for the producer once the consumer
+        // ran
         void clear()
         {
-            head_ = tail_ = 0;
+            // Offset by one so that zero means nothing to discard
+            discard_.store(head_.load(std::memory_order_acquire) + 1, std::memory_order_release);
+        }
+
+        std::size_t underruns() const
+        {
+            return underruns_.load(std::memory_order_relaxed);
+        }
+
+        std::size_t overruns() const
+        {
+            return overruns_.load(std::memory_order_relaxed);
+        }
+
+        void reset_stats()
+        {
+            underruns_.store(0, std::memory_order_relaxed);
+            overruns_.store(0, std::memory_order_relaxed);
         }
 
     private:
         ringbuffer(const ringbuffer&) = delete;
         ringbuffer& operator=(const ringbuffer&) = delete;
 
+        static constexpr std::size_t mask = count - 1;
+        // Not std::hardware_destructive_interference_size, it's not available everywhere and
+        // warns on gcc
+        static constexpr std::size_t cache_line = 64;
+
+        // head_ is only written by the producer and tail_ only by the consumer, keep them on
+        // separate cache lines so they don't bounce between the two cores
+        alignas(cache_line) std::atomic<std::size_t> head_ = 0;
+        alignas(cache_line) std::atomic<std::size_t> tail_ = 0;
+        alignas(cache_line) std::atomic<std::size_t> underruns_ = 0;
+        std::atomic<std::size_t> discard_ = 0;
+        std::atomic<std::size_t> overruns_ = 0;
         uint8_t* buffer_;
-        std::size_t head_ = 0;
-        std::size_t tail_ = 0;
     };
 
-} // namespace hydra
\ No newline at end of file
+} // namespace hydra
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace hydra
+{
+
+    // Incremental hash, fed with consecutive chunks of a file
+    class RomHasher
+    {
+    public:
+        virtual ~RomHasher() = default;
+        virtual void Update(const uint8_t* data, size_t size) = 0;
+        // Lowercase hex digest
+        virtual std::string Finish() = 0;
+    };
+
+    struct RomHashAlgorithm
+    {
+        const char* name;
+        std::unique_ptr<RomHasher> (*create)();
+    };
+
+    // md5 is what the cheat and save files have always been keyed by, xxh64 is many times faster
+    // but files keyed by the other algorithm won't be found after switching
+    const std::vector<RomHashAlgorithm>& rom_hash_algorithms();
+
+    // Hashes a rom with the named algorithm, or md5 if the name is unknown. The file is memory
+    // mapped and the results are cached on disk by path, size, modification time and inode, so
+    // hashing an unchanged file a second time costs a stat. Safe to call from any thread
+    std::string hash_rom(const std::filesystem::path& path, std::string_view algorithm);
+
+} // namespace hydra
@@ -1,18 +1,59 @@
 #pragma once
 
 #include "log.h"
+#include <algorithm>
+#include <atomic>
 #include <compatibility.hxx>
 #include <corewrapper.hxx>
+#include <cstdlib>
 #include <error_factory.hxx>
 #include <filesystem>
 #include <fmt/format.h>
 #include <fstream>
+#include <functional>
 #include <hydra/core.hxx>
 #include <json.hpp>
 #include <map>
 #include <memory>
 #include <mutex>
+#include <observer.hxx>
+#include <optional>
 #include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <writebehind.hxx>
+
+class Settings;
+
+namespace hydra
+{
+    template <class T>
+    class Setting;
+
+    // Type independent part of hydra::Setting, this is what Settings keeps track of
+    class SettingBase : public Subject
+    {
+    public:
+        const std::string& GetKey() const
+        {
+            return key_;
+        }
+
+    protected:
+        SettingBase(std::string key) : key_(std::move(key)) {}
+
+        virtual ~SettingBase() = default;
+
+        // Called with the settings lock held, with the new stored string or an empty string
+        // if the key is missing
+        virtual void refresh(const std::string& value) = 0;
+
+    private:
+        std::string key_;
+
+        friend class ::Settings;
+    };
+} // namespace hydra
 
 struct EmulatorInfo
 {
@@ -27,27 +68,33 @@ struct EmulatorInfo
     int max_players;
     std::vector<std::string> firmware_files;
     std::vector<std::string> extensions;
+    // One per player, registered by InitCoreInfo
+    std::vector<std::shared_ptr<hydra::Setting<bool>>> controller_active;
 };
 
-// Essentially a wrapper around a std::map<std::string, std::string> that locks a mutex
-// upon access and has a save function that saves as a json to file
+// An in-memory std::map<std::string, std::string> that is saved as json. Reads go through an
+// immutable snapshot that is swapped out on every Set, so they never block or touch the disk.
+// Changes are coalesced and written to the file in the background. Code that reads a setting
+// often should use a hydra::Setting handle instead of looking the key up every time
 class Settings
 {
     using json = nlohmann::json;
+    using map_t = std::map<std::string, std::string>;
     Settings() = delete;
     ~Settings() = delete;
 
 public:
     static void Open(const std::filesystem::path& path)
     {
-        map().clear();
+        std::unique_lock<std::mutex> lock(write_mutex());
         save_path() = path;
         std::ifstream ifs(save_path());
         if (ifs.good())
         {
             json j_map;
             ifs >> j_map;
-            map() = j_map.get<std::map<std::string, std::string>>();
+            std::atomic_store(&snapshot(), std::make_shared<const map_t>(j_map.get<map_t>()));
+            refresh_all();
         }
         else
         {
@@ -57,26 +104,98 @@ public:
 
     static std::string Get(const std::string& key)
     {
-        if (map().find(key) == map().end())
+        std::shared_ptr<const map_t> current = std::atomic_load(&snapshot());
+        auto it = current->find(key);
+        if (it == current->end())
         {
+            // Added so that the key shows up in the settings file
             Set(key, "");
             return "";
         }
 
-        return map()[key];
+        return it->second;
     }
 
     static void Set(const std::string& key, const std::string& value)
     {
-        map()[key] = value;
-        std::ofstream ofs(save_path(), std::ios::trunc);
-        json j_map(map());
-        ofs << j_map << std::endl;
+        std::vector<hydra::SettingBase*> changed;
+        {
+            std::unique_lock<std::mutex> lock(write_mutex());
+            std::shared_ptr<const map_t> current = std::atomic_load(&snapshot());
+            auto it = current->find(key);
+            if (it != current->end() && it->second == value)
+                return;
+
+            auto next = std::make_shared<map_t>(*current);
+            (*next)[key] = value;
+            std::atomic_store(&snapshot(), std::shared_ptr<const map_t>(std::move(next)));
+
+            auto [begin, end] = handles().equal_range(key);
+            for (auto handle = begin; handle != end; ++handle)
+            {
+                handle->second->refresh(value);
+                changed.push_back(handle->second);
+            }
+        }
+        flusher().MarkDirty();
+
+        // Outside the write lock, so observers are free to change settings themselves. The
+        // notify lock keeps handles from being unregistered while they are notified, one that
+        // was unregistered since it was collected is skipped
+        std::lock_guard<std::recursive_mutex> notify_lock(notify_mutex());
+        for (hydra::SettingBase* handle : changed)
+        {
+            if (is_registered(key, handle))
+                handle->notify();
+        }
+    }
+
+    // Drops every setting, the emptied file is written like any other change
+    static void Clear()
+    {
+        {
+            std::unique_lock<std::mutex> lock(write_mutex());
+            std::atomic_store(&snapshot(), std::make_shared<const map_t>());
+            refresh_all();
+        }
+        flusher().MarkDirty();
+    }
+
+    // Used by hydra::Setting, a key can have any number of handles
+    static void Register(hydra::SettingBase* handle)
+    {
+        std::unique_lock<std::mutex> lock(write_mutex());
+        handles().emplace(handle->GetKey(), handle);
+        std::shared_ptr<const map_t> current = std::atomic_load(&snapshot());
+        auto it = current->find(handle->GetKey());
+        handle->refresh(it != current->end() ? it->second : "");
+    }
+
+    // Waits for notifications of the handle that are in progress on other threads
+    static void Unregister(hydra::SettingBase* handle)
+    {
+        std::lock_guard<std::recursive_mutex> notify_lock(notify_mutex());
+        std::unique_lock<std::mutex> lock(write_mutex());
+        auto [begin, end] = handles().equal_range(handle->GetKey());
+        for (auto it = begin; it != end; ++it)
+        {
+            if (it->second == handle)
+            {
+                handles().erase(it);
+                break;
+            }
+        }
+    }
+
+    // Writes pending changes now instead of waiting for the background flush
+    static void Flush()
+    {
+        flusher().Flush();
     }
 
     static bool IsEmpty()
     {
-        return map().empty();
+        return std::atomic_load(&snapshot())->empty();
     }
 
     static std::filesystem::path GetSavePath()
@@ -150,100 +269,24 @@ public:
         return dir;
     }
 
-    static void InitCoreInfo()
-    {
-        if (core_info_initialized())
-            return;
-        core_info_initialized() = true;
-        if (Settings::Get("core_path").empty())
-        {
-            Settings::Set("core_path", (std::filesystem::current_path()).string());
-        }
-
-        if (!std::filesystem::exists(Settings::Get("core_path")))
-        {
-            printf("Failed to find initialize core info\n");
-            return;
-        }
-
-        std::filesystem::directory_iterator it(Settings::Get("core_path"));
-        std::filesystem::directory_iterator end;
-        while (it != end)
-        {
-            if (it->path().extension() == hydra::dynlib_get_extension())
-            {
-                // TODO: cache these to a json or whatever so we don't dlopen every time
-                void* handle = hydra::dynlib_open(it->path().string().c_str());
-
-                struct Destructor
-                {
-                    void* handle;
-
-                    ~Destructor()
-                    {
-                        hydra::dynlib_close(handle);
-                    }
-                };
-
-                Destructor d{handle};
-
-                if (!handle)
-                {
-                    printf("%s\n", hydra::dynlib_get_error().c_str());
-                    ++it;
-                    continue;
-                }
+    // Defined below hydra::Setting, which it uses
+    static void InitCoreInfo();
 
-                auto get_info_p =
-                    (decltype(hydra::getInfo)*)hydra::dynlib_get_symbol(handle, "getInfo");
-                if (!get_info_p)
-                {
-                    log_warn(
-                        fmt::format("Could not find symbol getInfo in core {}", it->path().string())
-                            .c_str());
-                    ++it;
-                    continue;
-                }
-                EmulatorInfo info;
-                info.path = it->path().string();
-                info.core_name = get_info_p(hydra::InfoType::CoreName);
-                info.system_name = get_info_p(hydra::InfoType::SystemName);
-                info.version = get_info_p(hydra::InfoType::Version);
-                info.author = get_info_p(hydra::InfoType::Author);
-                info.description = get_info_p(hydra::InfoType::Description);
-                info.extensions = hydra::split(get_info_p(hydra::InfoType::Extensions), ',');
-                info.url = get_info_p(hydra::InfoType::Website);
-                info.license = get_info_p(hydra::InfoType::License);
-                info.firmware_files = hydra::split(get_info_p(hydra::InfoType::Firmware), ',');
-                info.max_players = 1;
-
-                bool one_active = false;
-                for (int i = 1; i <= info.max_players; i++)
-                {
-                    std::string active = Settings::Get(info.core_name + "_controller_" +
-                                                       std::to_string(i) + "_active");
-                    if (active == "true")
-                    {
-                        one_active = true;
-                    }
-                    else if (active.empty())
-                    {
-                        Settings::Set(info.core_name + "_controller_" + std::to_string(i) +
-                                          "_active",
-                                      "false");
-                    }
-                }
-                if (!one_active)
-                {
-                    Settings::Set(info.core_name + "_controller_1_active", "true");
-                }
-                CoreInfo().push_back(info);
-            }
+    // Opens a core without creating an emulator and reads its info through getInfo. Also caches
+    // its icon. Safe to call from any thread
+    static std::optional<EmulatorInfo> ProbeCore(const std::filesystem::path& path);
 
-            ++it;
-        }
+    // Where the icon of a core is cached as a png
+    static std::filesystem::path GetCoreIconPath(const std::string& core_name)
+    {
+        return GetCachePath() / (core_name + ".png");
     }
 
+    // Writes the icon to GetCoreIconPath if it isn't there yet, returns false if the core has
+    // no usable icon
+    static bool CacheCoreIcon(const std::string& core_name,
+                              const char* (*get_info)(hydra::InfoType));
+
     static void ReinitCoreInfo()
     {
         core_info_initialized() = false;
@@ -256,7 +299,7 @@ public:
         std::string ret;
         ret += fmt::format("version: {}\n", HYDRA_VERSION);
         ret += fmt::format("system: {}\n", hydra_os());
-        ret += fmt::format("settings:\n{}\n", json(map()).dump(4));
+        ret += fmt::format("settings:\n{}\n", json(*std::atomic_load(&snapshot())).dump(4));
         return ret;
     }
 
@@ -267,21 +310,493 @@ public:
     }
 
 private:
-    static std::map<std::string, std::string>& map()
+    static std::shared_ptr<const map_t>& snapshot()
+    {
+        static std::shared_ptr<const map_t> s = std::make_shared<const map_t>();
+        return s;
+    }
+
+    static std::mutex& write_mutex()
     {
-        static std::map<std::string, std::string> m;
+        static std::mutex m;
         return m;
     }
 
+    // Held while observers of settings are notified and while handles are unregistered, taken
+    // before write_mutex. Recursive because observers may set or destroy settings, but they must
+    // not wait on another thread that does
+    static std::recursive_mutex& notify_mutex()
+    {
+        static std::recursive_mutex m;
+        return m;
+    }
+
+    static std::unordered_multimap<std::string, hydra::SettingBase*>& handles()
+    {
+        static std::unordered_multimap<std::string, hydra::SettingBase*> h;
+        return h;
+    }
+
+    // Doesn't touch the handle, it may be gone already
+    static bool is_registered(const std::string& key, hydra::SettingBase* handle)
+    {
+        std::unique_lock<std::mutex> lock(write_mutex());
+        auto [begin, end] = handles().equal_range(key);
+        return std::any_of(begin, end, [handle](const auto& it) { return it.second == handle; });
+    }
+
+    // Must be called with write_mutex held
+    static void refresh_all()
+    {
+        std::shared_ptr<const map_t> current = std::atomic_load(&snapshot());
+        for (auto& [key, handle] : handles())
+        {
+            auto it = current->find(key);
+            handle->refresh(it != current->end() ? it->second : "");
+        }
+    }
+
+    // Constructed after the statics it uses, so it is destroyed, and does its final flush, first
+    static hydra::WriteBehind& flusher()
+    {
+        static hydra::WriteBehind w(&Settings::save);
+        return w;
+    }
+
+    static void save()
+    {
+        std::filesystem::path path;
+        {
+            std::unique_lock<std::mutex> lock(write_mutex());
+            path = save_path();
+        }
+        if (path.empty())
+            return;
+
+        std::string data = json(*std::atomic_load(&snapshot())).dump() + "\n";
+        hydra::write_file_atomic(path, data);
+    }
+
     static std::filesystem::path& save_path()
     {
         static std::filesystem::path p;
         return p;
     }
 
+    // Bump when the cached fields change
+    static constexpr int core_cache_version = 1;
+
+    static json load_core_cache(const std::filesystem::path& path);
+    static uint64_t hash_file(const std::filesystem::path& path);
+    static json core_info_to_json(const EmulatorInfo& info);
+    static std::optional<EmulatorInfo> core_info_from_json(const json& j,
+                                                           const std::string& path);
+
     static bool& core_info_initialized()
     {
         static bool b;
         return b;
     }
 };
+
+namespace hydra
+{
+    // A typed handle to one setting. The value is parsed once whenever the setting changes and
+    // cached, in an atomic for bool and numbers and as an immutable shared object otherwise, so
+    // Get never locks, hashes or parses. An empty or unparsable stored value reads as the default
+    template <class T>
+    class Setting final : public SettingBase
+    {
+        static constexpr bool is_atomic = std::is_arithmetic_v<T>;
+        static_assert(is_atomic || std::is_same_v<T, std::string> ||
+                          std::is_same_v<T, std::filesystem::path>,
+                      "unsupported setting type");
+
+    public:
+        Setting(std::string key, T default_value = T{})
+            : SettingBase(std::move(key)), default_(std::move(default_value))
+        {
+            Settings::Register(this);
+        }
+
+        ~Setting()
+        {
+            Settings::Unregister(this);
+        }
+
+        T Get() const
+        {
+            if constexpr (is_atomic)
+                return value_.load(std::memory_order_relaxed);
+            else
+                return *std::atomic_load(&value_);
+        }
+
+        void Set(const T& value)
+        {
+            Settings::Set(GetKey(), format(value));
+        }
+
+    private:
+        void refresh(const std::string& str) override
+        {
+            if constexpr (is_atomic)
+                value_.store(parse(str), std::memory_order_relaxed);
+            else
+                std::atomic_store(&value_, std::make_shared<const T>(parse(str)));
+        }
+
+        T parse(const std::string& str) const
+        {
+            if (str.empty())
+                return default_;
+
+            if constexpr (std::is_same_v<T, bool>)
+            {
+                return str == "true";
+            }
+            else if constexpr (std::is_integral_v<T>)
+            {
+                char* end;
+                long long value = std::strtoll(str.c_str(), &end, 10);
+                return *end == '\0' ? static_cast<T>(value) : default_;
+            }
+            else if constexpr (std::is_floating_point_v<T>)
+            {
+                char* end;
+                double value = std::strtod(str.c_str(), &end);
+                return *end == '\0' ? static_cast<T>(value) : default_;
+            }
+            else
+            {
+                return T(str);
+            }
+        }
+
+        static std::string format(const T& value)
+        {
+            if constexpr (std::is_same_v<T, bool>)
+                return value ? "true" : "false";
+            else if constexpr (is_atomic)
+                return fmt::format("{}", value);
+            else if constexpr (std::is_same_v<T, std::filesystem::path>)
+                return value.string();
+            else
+                return value;
+        }
+
+        const T default_;
+        std::conditional_t<is_atomic, std::atomic<T>, std::shared_ptr<const T>> value_{};
+
+        Setting(const Setting&) = delete;
+        Setting& operator=(const Setting&) = delete;
+    };
+
+    // Calls a function whenever a setting changes, on the thread that changed it
+    class SettingCallback : public Observer
+    {
+    public:
+        SettingCallback(SettingBase& setting, std::function<void()> callback)
+            : Observer(&setting), callback_(std::move(callback))
+        {
+            subject_->attach(this);
+        }
+
+        ~SettingCallback()
+        {
+            subject_->detach(this);
+        }
+
+    private:
+        void update() override
+        {
+            callback_();
+        }
+
+        std::function<void()> callback_;
+    };
+
+    // Settings that are read on hot paths or from several threads
+    namespace setting
+    {
+        inline Setting<bool> print_to_native_terminal{"print_to_native_terminal", false};
+        inline Setting<int> master_volume{"master_volume", 100};
+        inline Setting<std::string> audio_resample_quality{"audio_resample_quality", "medium"};
+        inline Setting<int> audio_latency_ms{"audio_latency_ms", 64};
+        inline Setting<std::string> sync_mode{"sync_mode", "video"};
+        // Set by --sync-mode, used instead of sync_mode for this session only and never saved
+        inline std::string sync_mode_override;
+        inline Setting<std::string> frame_lag_policy{"frame_lag_policy", "catchup"};
+        // See hydra::rom_hash_algorithms, cheats are stored under this hash
+        inline Setting<std::string> rom_hash{"rom_hash", "md5"};
+        // Core downloads that run at the same time, see hydra::DownloadManager
+        inline Setting<int> max_downloads{"max_downloads", 4};
+    } // namespace setting
+} // namespace hydra
+
+inline std::optional<EmulatorInfo> Settings::ProbeCore(const std::filesystem::path& path)
+{
+    void* handle = hydra::dynlib_open(path.string().c_str());
+
+    struct Destructor
+    {
+        void* handle;
+
+        ~Destructor()
+        {
+            hydra::dynlib_close(handle);
+        }
+    };
+
+    Destructor d{handle};
+
+    if (!handle)
+    {
+        printf("%s\n", hydra::dynlib_get_error().c_str());
+        return std::nullopt;
+    }
+
+    auto get_info_p = (decltype(hydra::getInfo)*)hydra::dynlib_get_symbol(handle, "getInfo");
+    if (!get_info_p)
+    {
+        log_warn(fmt::format("Could not find symbol getInfo in core {}", path.string()).c_str());
+        return std::nullopt;
+    }
+    EmulatorInfo info;
+    info.path = path.string();
+    info.core_name = get_info_p(hydra::InfoType::CoreName);
+    info.system_name = get_info_p(hydra::InfoType::SystemName);
+    info.version = get_info_p(hydra::InfoType::Version);
+    info.author = get_info_p(hydra::InfoType::Author);
+    info.description = get_info_p(hydra::InfoType::Description);
+    info.extensions = hydra::split(get_info_p(hydra::InfoType::Extensions), ',');
+    info.url = get_info_p(hydra::InfoType::Website);
+    info.license = get_info_p(hydra::InfoType::License);
+    info.firmware_files = hydra::split(get_info_p(hydra::InfoType::Firmware), ',');
+    info.max_players = 1;
+    // While the library is open anyway
+    CacheCoreIcon(info.core_name, get_info_p);
+    return info;
+}
+
+inline bool Settings::CacheCoreIcon(const std::string& core_name,
+                                    const char* (*get_info)(hydra::InfoType))
+{
+    std::filesystem::path path = GetCoreIconPath(core_name);
+    if (std::filesystem::exists(path))
+        return true;
+
+    std::optional<hydra::CoreIcon> icon = hydra::read_core_icon(get_info);
+    if (!icon)
+        return false;
+
+    std::vector<uint8_t> png = hydra::encode_png(*icon);
+    if (png.empty())
+        return false;
+    return hydra::write_file_atomic(
+        path, std::string_view(reinterpret_cast<const char*>(png.data()), png.size()));
+}
+
+inline void Settings::InitCoreInfo()
+{
+    if (core_info_initialized())
+        return;
+    core_info_initialized() = true;
+    if (Settings::Get("core_path").empty())
+    {
+        Settings::Set("core_path", (std::filesystem::current_path()).string());
+    }
+
+    if (!std::filesystem::exists(Settings::Get("core_path")))
+    {
+        printf("Failed to find initialize core info\n");
+        return;
+    }
+
+    // Cores are only opened when they aren't in the cache or they changed on disk since, which
+    // usually leaves a stat per core
+    std::filesystem::path cache_path = GetCachePath() / "core_cache.json";
+    json cache = load_core_cache(cache_path);
+    json& cached_cores = cache["cores"];
+    json seen_cores = json::object();
+    bool cache_dirty = false;
+
+    struct Candidate
+    {
+        std::filesystem::path path;
+        uint64_t size;
+        int64_t mtime;
+        json entry;
+        std::optional<EmulatorInfo> info;
+    };
+    std::vector<Candidate> candidates;
+    std::vector<size_t> misses;
+
+    std::filesystem::directory_iterator it(Settings::Get("core_path"));
+    std::filesystem::directory_iterator end;
+    for (; it != end; ++it)
+    {
+        if (it->path().extension() != hydra::dynlib_get_extension())
+            continue;
+
+        Candidate candidate;
+        candidate.path = it->path();
+        std::error_code error;
+        candidate.size = std::filesystem::file_size(it->path(), error);
+        candidate.mtime = std::filesystem::last_write_time(it->path(), error)
+                              .time_since_epoch()
+                              .count();
+        if (error)
+        {
+            log_warn(fmt::format("Failed to stat core {}: {}", candidate.path.string(),
+                                 error.message())
+                         .c_str());
+            continue;
+        }
+
+        auto cached = cached_cores.find(candidate.path.string());
+        if (cached != cached_cores.end() && cached->is_object())
+        {
+            candidate.entry = *cached;
+            if (candidate.entry["size"] == candidate.size &&
+                candidate.entry["mtime"] == candidate.mtime)
+            {
+                candidate.info =
+                    core_info_from_json(candidate.entry["info"], candidate.path.string());
+            }
+        }
+
+        if (!candidate.info)
+            misses.push_back(candidates.size());
+        candidates.push_back(std::move(candidate));
+    }
+
+    // Hashing and probing are bound by I/O and the dynamic loader, not by this thread, so the
+    // misses are all handled at once
+    hydra::parallel_jobs(misses.size(), [&candidates, &misses](size_t i) {
+        Candidate& candidate = candidates[misses[i]];
+        uint64_t hash = hash_file(candidate.path);
+        if (candidate.entry.is_object() && candidate.entry["size"] == candidate.size &&
+            candidate.entry["hash"] == hash)
+        {
+            // Touched but not changed
+            candidate.info = core_info_from_json(candidate.entry["info"], candidate.path.string());
+        }
+
+        if (!candidate.info)
+            candidate.info = ProbeCore(candidate.path);
+
+        if (candidate.info)
+        {
+            candidate.entry = json::object();
+            candidate.entry["size"] = candidate.size;
+            candidate.entry["mtime"] = candidate.mtime;
+            candidate.entry["hash"] = hash;
+            candidate.entry["info"] = core_info_to_json(*candidate.info);
+        }
+    });
+    cache_dirty = !misses.empty();
+
+    for (Candidate& candidate : candidates)
+    {
+        if (!candidate.info)
+            continue;
+
+        std::optional<EmulatorInfo>& info = candidate.info;
+        seen_cores[candidate.path.string()] = std::move(candidate.entry);
+
+        bool one_active = false;
+        for (int i = 1; i <= info->max_players; i++)
+        {
+            auto active = std::make_shared<hydra::Setting<bool>>(
+                info->core_name + "_controller_" + std::to_string(i) + "_active", false);
+            // Writes the default if the key is missing, so it shows up in the file
+            active->Set(active->Get());
+            one_active |= active->Get();
+            info->controller_active.push_back(active);
+        }
+        if (!one_active)
+        {
+            info->controller_active[0]->Set(true);
+        }
+        CoreInfo().push_back(std::move(*info));
+    }
+
+    // Forget about cores that were removed
+    if (cached_cores.size() != seen_cores.size())
+        cache_dirty = true;
+    if (cache_dirty)
+    {
+        cache["cores"] = std::move(seen_cores);
+        hydra::write_file_atomic(cache_path, cache.dump());
+    }
+}
+
+inline nlohmann::json Settings::load_core_cache(const std::filesystem::path& path)
+{
+    json cache;
+    std::ifstream ifs(path);
+    if (ifs.good())
+    {
+        cache = json::parse(ifs, nullptr, false);
+    }
+
+    if (!cache.is_object() || cache["version"] != core_cache_version ||
+        !cache["cores"].is_object())
+    {
+        cache = json::object();
+        cache["version"] = core_cache_version;
+        cache["cores"] = json::object();
+    }
+    return cache;
+}
+
+inline uint64_t Settings::hash_file(const std::filesystem::path& path)
+{
+    std::ifstream ifs(path, std::ios::binary);
+    std::vector<uint8_t> buffer(1 << 16);
+    uint64_t hash = hydra::fnv1a64(nullptr, 0);
+    while (ifs.good())
+    {
+        ifs.read(reinterpret_cast<char*>(buffer.data()), buffer.size());
+        hash = hydra::fnv1a64(buffer.data(), ifs.gcount(), hash);
+    }
+    return hash;
+}
+
+inline nlohmann::json Settings::core_info_to_json(const EmulatorInfo& info)
+{
+    json j;
+    j["core_name"] = info.core_name;
+    j["system_name"] = info.system_name;
+    j["author"] = info.author;
+    j["version"] = info.version;
+    j["description"] = info.description;
+    j["license"] = info.license;
+    j["url"] = info.url;
+    j["max_players"] = info.max_players;
+    j["firmware_files"] = info.firmware_files;
+    j["extensions"] = info.extensions;
+    return j;
+}
+
+inline std::optional<EmulatorInfo> Settings::core_info_from_json(const json& j,
+                                                                 const std::string& path)
+{
+    if (!j.is_object())
+        return std::nullopt;
+
+    EmulatorInfo info;
+    info.path = path;
+    info.core_name = j.value("core_name", "");
+    info.system_name = j.value("system_name", "");
+    info.author = j.value("author", "");
+    info.version = j.value("version", "");
+    info.description = j.value("description", "");
+    info.license = j.value("license", "");
+    info.url = j.value("url", "");
+    info.max_players = j.value("max_players", 1);
+    info.firmware_files = j.value("firmware_files", std::vector<std::string>{});
+    info.extensions = j.value("extensions", std::vector<std::string>{});
+    return info;
+}
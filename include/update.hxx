@@ -2,28 +2,26 @@
 
 #include "compatibility.hxx"
 #include "corewrapper.hxx"
+#include "databaseindex.hxx"
 #include "json.hpp"
+#include "scopeguard.hxx"
 #include "settings.hxx"
+#include "writebehind.hxx"
+#include <algorithm>
+#include <cstdlib>
 #include <download.hxx>
+#include <fmt/format.h>
+#include <log.h>
 #include <miniz/miniz.h>
 #include <mutex>
 #include <sstream>
 #include <thread>
+#include <unordered_set>
 
 namespace hydra
 {
     struct Updater
     {
-    private:
-        struct DatabaseEntry
-        {
-            std::string CoreName;
-            std::string CoreSubName;
-            std::string Versioning;
-            std::string VersioningURL;
-            std::unordered_map<std::string, std::string> Downloads;
-        };
-
     public:
         enum UpdateStatus
         {
@@ -51,45 +49,99 @@ namespace hydra
             return is_newer_date(old_date, new_date) ? UpdateAvailable : UpToDate;
         }
 
-        static UpdateStatus NeedsCoreUpdate(const std::string& core_name)
+        struct CoreUpdate
         {
-            if (Settings::Get(core_name + "_date").empty())
-                return UpdateAvailable;
-
-            std::mutex& mutex = GetMutex();
-            std::lock_guard<std::mutex> lock(mutex);
-
-            std::filesystem::path database_path =
-                Settings::GetSavePath() / "database" / (core_name + ".json");
-            if (!std::filesystem::exists(database_path))
-                return Error;
-
-            nlohmann::json database;
-            std::ifstream file(database_path);
-            file >> database;
+            std::string core_name;
+            UpdateStatus status = Error;
+            // Date of the latest version, to be stored as <core_name>_date once it's installed
+            std::string date;
+            // Download for this platform, empty if there is none
+            std::string url;
+        };
 
-            std::string versioning = database["Versioning"];
-            std::string versioning_url = database["VersioningURL"];
-            printf("Versioning: %s\n", versioning_url.c_str());
+        static UpdateStatus NeedsCoreUpdate(const std::string& core_name)
+        {
+            return CheckCoreUpdates({core_name})[0].status;
+        }
 
-            if (versioning == "Github")
+        // Checks many cores at once. Cores that share a versioning url are checked with one
+        // request, and the requests run concurrently over pooled connections. Unchanged ones
+        // are a 304 each
+        static std::vector<CoreUpdate> CheckCoreUpdates(const std::vector<std::string>& core_names)
+        {
+            std::vector<CoreUpdate> updates(core_names.size());
+            std::vector<std::string> versioning_urls(core_names.size());
             {
-                HydraBufferWrapper buffer = Downloader::Download(versioning_url);
-                if (buffer.empty())
-                    return Error;
-
-                nlohmann::json versioning_json = nlohmann::json::parse((char*)buffer.data());
-                std::string last_date = versioning_json["commit"]["commit"]["committer"]["date"];
-                std::string old_date = Settings::Get(core_name + "_date");
-
-                return is_newer_date(old_date, last_date) ? UpdateAvailable : UpToDate;
+                std::mutex& mutex = GetMutex();
+                std::lock_guard<std::mutex> lock(mutex);
+                for (size_t i = 0; i < core_names.size(); i++)
+                {
+                    updates[i].core_name = core_names[i];
+                    std::ifstream file(Settings::GetSavePath() / "database" /
+                                       (core_names[i] + ".json"));
+                    nlohmann::json database = nlohmann::json::parse(file, nullptr, false);
+                    try
+                    {
+                        if (database["Versioning"] != "Github")
+                        {
+                            log_warn(fmt::format("Unknown versioning type for {}", core_names[i])
+                                         .c_str());
+                            continue;
+                        }
+                        versioning_urls[i] = database["VersioningURL"];
+                        auto download = database["Downloads"].find(hydra_os());
+                        if (download != database["Downloads"].end())
+                            updates[i].url = *download;
+                    } catch (const std::exception&)
+                    {
+                        // Not in the database, or not a valid entry
+                        versioning_urls[i].clear();
+                    }
+                }
             }
-            else
+
+            std::vector<std::string> unique_urls;
+            for (const std::string& url : versioning_urls)
             {
-                log_fatal("Unknown versioning type");
+                if (!url.empty())
+                    unique_urls.push_back(url);
             }
+            std::sort(unique_urls.begin(), unique_urls.end());
+            unique_urls.erase(std::unique(unique_urls.begin(), unique_urls.end()),
+                              unique_urls.end());
+
+            std::vector<std::string> dates(unique_urls.size());
+            hydra::parallel_jobs(unique_urls.size(), [&unique_urls, &dates](size_t i) {
+                HydraBufferWrapper buffer = cached_download(unique_urls[i]);
+                nlohmann::json versioning_json =
+                    nlohmann::json::parse(buffer.begin(), buffer.end(), nullptr, false);
+                try
+                {
+                    dates[i] = versioning_json["commit"]["commit"]["committer"]["date"];
+                } catch (const std::exception&)
+                {
+                    printf("Failed to get the version from %s\n", unique_urls[i].c_str());
+                }
+            });
 
-            return Error;
+            for (size_t i = 0; i < updates.size(); i++)
+            {
+                if (versioning_urls[i].empty())
+                    continue;
+                auto it = std::lower_bound(unique_urls.begin(), unique_urls.end(),
+                                           versioning_urls[i]);
+                updates[i].date = dates[it - unique_urls.begin()];
+
+                std::string old_date = Settings::Get(updates[i].core_name + "_date");
+                if (old_date.empty())
+                    updates[i].status = UpdateAvailable;
+                else if (updates[i].date.empty())
+                    updates[i].status = Error;
+                else
+                    updates[i].status =
+                        is_newer_date(old_date, updates[i].date) ? UpdateAvailable : UpToDate;
+            }
+            return updates;
         }
 
         static void UpdateDatabase(std::function<void()> callback)
@@ -97,139 +149,413 @@ namespace hydra
             std::thread t([callback]() {
                 std::mutex& mutex = GetMutex();
                 std::lock_guard<std::mutex> lock(mutex);
-                HydraBufferWrapper buffer = Downloader::Download(
-                    "https://github.com/hydra-emu/database/archive/refs/heads/master.zip");
+                const std::string url = get_database_url();
+                std::filesystem::path zip_path = get_download_path(url);
+                if (zip_path.empty())
+                    return;
 
-                if (buffer.empty())
+                // A 304 means the files on disk already match the zip, but only if the last
+                // update got all the way through, which is when the validators are stored
+                HttpValidators validators = load_cache_entry(url).first;
+                if (!std::filesystem::exists(get_index_path()))
+                    validators = {};
+
+                DownloadResult result =
+                    Downloader::DownloadToFileIfModified(url, zip_path, &validators);
+                if (result == DownloadResult::Failed)
                 {
                     printf("Failed to download database. No internet connection?\n");
                     return;
                 }
-
-                mz_zip_archive zip_archive;
-                memset(&zip_archive, 0, sizeof(zip_archive));
-
-                if (!mz_zip_reader_init_mem(&zip_archive, buffer.data(), buffer.size(), 0))
-                    log_fatal("Failed to read database zip");
-
-                if (!std::filesystem::create_directories(Settings::GetSavePath() / "database"))
+                else if (result == DownloadResult::Downloaded)
                 {
-                    if (!std::filesystem::exists(Settings::GetSavePath() / "database"))
-                        log_fatal("Failed to create database directory");
+                    bool synced = sync_database(zip_path);
+                    std::error_code error;
+                    std::filesystem::remove(zip_path, error);
+                    if (!synced)
+                        return;
+                    store_cache_entry(url, validators, {});
                 }
 
-                for (size_t i = 0; i < mz_zip_reader_get_num_files(&zip_archive); i++)
-                {
-                    mz_zip_archive_file_stat file_stat;
-                    if (!mz_zip_reader_file_stat(&zip_archive, i, &file_stat))
-                        log_fatal("Failed to stat file in zip");
-
-                    std::filesystem::path path = file_stat.m_filename;
-                    if (path.extension() == ".json")
-                    {
-                        std::string data;
-                        data.resize(file_stat.m_uncomp_size);
-                        if (!mz_zip_reader_extract_to_mem(&zip_archive, i, data.data(), data.size(),
-                                                          0))
-                            log_fatal("Failed to extract file from zip");
-
-                        std::ofstream file(Settings::GetSavePath() / "database" / path.filename());
-                        file << data;
-                    }
-                }
                 Settings::Set("database_date", get_database_time());
                 callback();
             });
             t.detach();
         }
 
-        static std::unordered_map<std::string, std::vector<DatabaseEntry>> GetDatabase()
+        // Maps the index compiled from the database files at the last update, nothing is parsed.
+        // It is compiled here if it's missing or was written by another version. Keep it only as
+        // long as needed, the next update replaces the file
+        static std::unique_ptr<DatabaseIndex> GetDatabase()
         {
             std::filesystem::path database_path = Settings::GetSavePath() / "database";
             if (!std::filesystem::exists(database_path))
             {
                 if (!std::filesystem::create_directories(database_path))
                     log_fatal("Failed to create database directory");
-                return {};
             }
 
-            std::unordered_map<std::string, std::vector<DatabaseEntry>> database;
-            std::filesystem::directory_iterator end;
-
-            for (std::filesystem::directory_iterator it(database_path); it != end; ++it)
+            auto index = std::make_unique<DatabaseIndex>(get_index_path());
+            if (!index->Valid())
             {
-                if (it->path().extension() == ".json")
+                // An update compiles the index too, and may be halfway through replacing the
+                // files. Wait for it and check again instead of compiling from those files
+                index.reset();
+                std::mutex& mutex = GetMutex();
+                std::lock_guard<std::mutex> lock(mutex);
+                index = std::make_unique<DatabaseIndex>(get_index_path());
+                if (index->Valid())
+                    return index;
+
+                index.reset();
+                compile_index();
+                index = std::make_unique<DatabaseIndex>(get_index_path());
+                if (!index->Valid())
                 {
-                    std::ifstream file(it->path());
-                    nlohmann::json json;
-                    file >> json;
-
-                    DatabaseEntry entry;
-                    entry.CoreName = json["CoreName"];
-                    entry.CoreSubName = json["CoreSubName"];
-                    entry.Versioning = json["Versioning"];
-                    entry.VersioningURL = json["VersioningURL"];
-
-                    for (auto& url : json["Downloads"].items())
-                    {
-                        entry.Downloads[url.key()] = url.value();
-                    }
-
-                    std::vector systems = hydra::split(json["SystemNames"], ',');
-                    for (auto& system : systems)
-                    {
-                        database[system].push_back(entry);
-                    }
+                    log_warn("Failed to compile the core database");
+                    return nullptr;
                 }
             }
+            return index;
+        }
 
-            return database;
+        // Downloads a core zip to the cache and installs it. Blocking, progress is called from
+        // the downloading thread. A download that fails halfway continues from there next time
+        static bool DownloadCore(const std::string& url,
+                                 std::function<bool(uint64_t current, uint64_t total)> progress =
+                                     nullptr)
+        {
+            std::filesystem::path zip_path = get_download_path(url);
+            if (zip_path.empty() || !Downloader::DownloadToFileResumable(url, zip_path, progress))
+                return false;
+
+            bool installed = InstallCore(zip_path);
+            std::error_code error;
+            std::filesystem::remove(zip_path, error);
+            return installed;
         }
 
-        static void InstallCore(const std::vector<uint8_t>& zipped_core)
+        // Extracts the core in a downloaded zip to the core directory. The zip is read from disk
+        // and inflated straight into a file next to the core, so memory use doesn't grow with the
+        // size of the core, and the old core is only replaced once the new one passed the CRC
+        // check
+        static bool InstallCore(const std::filesystem::path& zip_path)
         {
             mz_zip_archive zip_archive;
             memset(&zip_archive, 0, sizeof(zip_archive));
 
-            if (!mz_zip_reader_init_mem(&zip_archive, zipped_core.data(), zipped_core.size(), 0))
-                log_fatal("Failed to read database zip");
+            if (!mz_zip_reader_init_file(&zip_archive, zip_path.string().c_str(), 0))
+            {
+                log_warn(fmt::format("Failed to read core zip {}", zip_path.string()).c_str());
+                return false;
+            }
+            hydra::ScopeGuard close_zip([&zip_archive]() { mz_zip_reader_end(&zip_archive); });
 
             if (mz_zip_reader_get_num_files(&zip_archive) != 1)
-                log_fatal("Invalid core zip");
+            {
+                log_warn("Invalid core zip");
+                return false;
+            }
 
             mz_zip_archive_file_stat file_stat;
             if (!mz_zip_reader_file_stat(&zip_archive, 0, &file_stat))
-                log_fatal("Failed to stat file in zip");
+            {
+                log_warn("Failed to stat file in core zip");
+                return false;
+            }
 
             std::filesystem::path path = file_stat.m_filename;
-            if (path.extension() == hydra::dynlib_get_extension())
+            if (path.extension() != hydra::dynlib_get_extension())
             {
-                std::string data;
-                data.resize(file_stat.m_uncomp_size);
-                if (!mz_zip_reader_extract_to_mem(&zip_archive, 0, data.data(), data.size(), 0))
-                    log_fatal("Failed to extract file from zip");
-
-                std::ofstream file(std::filesystem::path(Settings::Get("core_path")) /
-                                       path.filename(),
-                                   std::ios::binary);
-                file << data;
+                log_warn(fmt::format("Core zip contains {}, expected a {} file", path.string(),
+                                     hydra::dynlib_get_extension())
+                             .c_str());
+                return false;
             }
+
+            return extract_file(zip_archive, file_stat,
+                                std::filesystem::path(Settings::Get("core_path")) /
+                                    path.filename());
         }
 
     private:
+        // Downloads go to the cache so a crash never leaves a partial file anywhere that is read
+        static std::filesystem::path get_download_path(const std::string& url)
+        {
+            std::filesystem::path directory = Settings::GetCachePath() / "downloads";
+            std::error_code error;
+            std::filesystem::create_directories(directory, error);
+            if (error)
+            {
+                log_warn(fmt::format("Failed to create {}: {}", directory.string(),
+                                     error.message())
+                             .c_str());
+                return {};
+            }
+
+            uint64_t hash =
+                hydra::fnv1a64(reinterpret_cast<const uint8_t*>(url.data()), url.size());
+            return directory / fmt::format("{:016x}.zip", hash);
+        }
+
+        // Inflates one entry into a temporary file next to path and renames it over path. miniz
+        // checks the CRC32 from the zip directory while inflating, a mismatch fails the
+        // extraction
+        static bool extract_file(mz_zip_archive& zip_archive,
+                                 const mz_zip_archive_file_stat& file_stat,
+                                 const std::filesystem::path& path)
+        {
+            // Two downloads of the same core can finish at the same time
+            std::filesystem::path temp_path = path;
+            temp_path += fmt::format(".{:x}.tmp",
+                                     std::hash<std::thread::id>()(std::this_thread::get_id()));
+            std::error_code error;
+
+            if (!mz_zip_reader_extract_to_file(&zip_archive, file_stat.m_file_index,
+                                               temp_path.string().c_str(), 0))
+            {
+                log_warn(fmt::format("Failed to extract {}: {}", path.string(),
+                                     mz_zip_get_error_string(mz_zip_get_last_error(&zip_archive)))
+                             .c_str());
+                std::filesystem::remove(temp_path, error);
+                return false;
+            }
+
+            uint64_t size = std::filesystem::file_size(temp_path, error);
+            if (error || size != file_stat.m_uncomp_size)
+            {
+                log_warn(fmt::format("Extracted {} has the wrong size", path.string()).c_str());
+                std::filesystem::remove(temp_path, error);
+                return false;
+            }
+
+            std::filesystem::rename(temp_path, path, error);
+            if (error)
+            {
+                log_warn(fmt::format("Failed to rename {}: {}", temp_path.string(),
+                                     error.message())
+                             .c_str());
+                std::filesystem::remove(temp_path, error);
+                return false;
+            }
+            return true;
+        }
+
         static std::string get_database_time()
         {
-            HydraBufferWrapper result = Downloader::Download(
-                "https://api.github.com/repos/hydra-emu/database/commits/master");
+            HydraBufferWrapper result = cached_download(get_database_version_url());
             if (result.empty())
                 return std::string();
 
-            std::string data = std::string((char*)result.data(), result.size());
-            auto json = nlohmann::json::parse(data);
+            auto json = nlohmann::json::parse(result.begin(), result.end(), nullptr, false);
+            if (json.is_discarded())
+                return std::string();
             std::string date = json["commit"]["committer"]["date"];
             return date;
         }
 
+        // Both can be pointed at a local server for testing
+        static std::string get_database_url()
+        {
+            const char* url = std::getenv("HYDRA_DATABASE_URL");
+            if (url)
+                return url;
+            return "https://github.com/hydra-emu/database/archive/refs/heads/master.zip";
+        }
+
+        static std::string get_database_version_url()
+        {
+            const char* url = std::getenv("HYDRA_DATABASE_VERSION_URL");
+            if (url)
+                return url;
+            return "https://api.github.com/repos/hydra-emu/database/commits/master";
+        }
+
+        // Validators and, for small responses, bodies of earlier downloads, keyed by url
+        static std::filesystem::path get_http_cache_path()
+        {
+            return Settings::GetCachePath() / "http_cache.json";
+        }
+
+        static std::mutex& get_http_cache_mutex()
+        {
+            static std::mutex mutex;
+            return mutex;
+        }
+
+        static std::pair<HttpValidators, std::string> load_cache_entry(const std::string& url)
+        {
+            std::lock_guard<std::mutex> lock(get_http_cache_mutex());
+            std::ifstream ifs(get_http_cache_path());
+            nlohmann::json cache = nlohmann::json::parse(ifs, nullptr, false);
+            if (!cache.is_object() || !cache.contains(url) || !cache[url].is_object())
+                return {};
+
+            nlohmann::json& entry = cache[url];
+            HttpValidators validators;
+            validators.etag = entry.value("etag", "");
+            validators.last_modified = entry.value("last_modified", "");
+            return {validators, entry.value("body", "")};
+        }
+
+        static void store_cache_entry(const std::string& url, const HttpValidators& validators,
+                                      const std::string& body)
+        {
+            std::lock_guard<std::mutex> lock(get_http_cache_mutex());
+            std::ifstream ifs(get_http_cache_path());
+            nlohmann::json cache = nlohmann::json::parse(ifs, nullptr, false);
+            ifs.close();
+            if (!cache.is_object())
+                cache = nlohmann::json::object();
+
+            cache[url] = {
+                {"etag", validators.etag},
+                {"last_modified", validators.last_modified},
+                {"body", body},
+            };
+            hydra::write_file_atomic(get_http_cache_path(), cache.dump());
+        }
+
+        // For small json responses that are checked often. Unchanged ones cost a 304 round trip
+        // and are answered from the cache
+        static HydraBufferWrapper cached_download(const std::string& url)
+        {
+            auto [validators, body] = load_cache_entry(url);
+            if (body.empty())
+                validators = {};
+
+            HydraBufferWrapper buffer;
+            DownloadResult result = Downloader::DownloadIfModified(url, buffer, &validators);
+            if (result == DownloadResult::NotModified)
+                return {body.begin(), body.end()};
+            else if (result == DownloadResult::Downloaded &&
+                     (!validators.etag.empty() || !validators.last_modified.empty()))
+                store_cache_entry(url, validators, {buffer.begin(), buffer.end()});
+            return buffer;
+        }
+
+        static std::filesystem::path get_index_path()
+        {
+            return Settings::GetCachePath() / "database.idx";
+        }
+
+        // Extracts the database files whose CRC32 in the zip directory differs from the one of
+        // the file on disk, removes the ones that are gone and recompiles the index
+        static bool sync_database(const std::filesystem::path& zip_path)
+        {
+            mz_zip_archive zip_archive;
+            memset(&zip_archive, 0, sizeof(zip_archive));
+
+            if (!mz_zip_reader_init_file(&zip_archive, zip_path.string().c_str(), 0))
+            {
+                log_warn("Failed to read database zip");
+                return false;
+            }
+            hydra::ScopeGuard close_zip([&zip_archive]() { mz_zip_reader_end(&zip_archive); });
+
+            std::filesystem::path database_path = Settings::GetSavePath() / "database";
+            if (!std::filesystem::create_directories(database_path))
+            {
+                if (!std::filesystem::exists(database_path))
+                    log_fatal("Failed to create database directory");
+            }
+
+            std::unordered_map<std::string, uint32_t> old_files;
+            {
+                DatabaseIndex index(get_index_path());
+                if (index.Valid())
+                    old_files = index.GetFileCrcs();
+            }
+            std::unordered_set<std::string> zip_files;
+            size_t extracted = 0;
+
+            for (size_t i = 0; i < mz_zip_reader_get_num_files(&zip_archive); i++)
+            {
+                mz_zip_archive_file_stat file_stat;
+                if (!mz_zip_reader_file_stat(&zip_archive, i, &file_stat))
+                {
+                    log_warn("Failed to stat file in database zip");
+                    return false;
+                }
+
+                std::filesystem::path path = file_stat.m_filename;
+                if (path.extension() != ".json")
+                    continue;
+
+                std::string name = path.filename().string();
+                zip_files.insert(name);
+                auto old_file = old_files.find(name);
+                if (old_file != old_files.end() && old_file->second == file_stat.m_crc32 &&
+                    std::filesystem::exists(database_path / name))
+                    continue;
+
+                // Entries already replaced stay replaced, they are complete files either way,
+                // but the validators aren't stored so the next update downloads it again
+                if (!extract_file(zip_archive, file_stat, database_path / name))
+                    return false;
+                extracted++;
+            }
+
+            for (auto& [name, _] : old_files)
+            {
+                if (zip_files.find(name) == zip_files.end())
+                {
+                    std::error_code error;
+                    std::filesystem::remove(database_path / name, error);
+                }
+            }
+
+            printf("Database update changed %zu files\n", extracted);
+            compile_index();
+            return true;
+        }
+
+        // Parses every database file once, along with the CRC32 of each file for the next update
+        // to compare against
+        static bool compile_index()
+        {
+            std::filesystem::path database_path = Settings::GetSavePath() / "database";
+            std::vector<std::filesystem::path> paths;
+            std::error_code error;
+            for (const auto& file : std::filesystem::directory_iterator(database_path, error))
+            {
+                if (file.path().extension() == ".json")
+                    paths.push_back(file.path());
+            }
+            std::sort(paths.begin(), paths.end());
+
+            std::vector<DatabaseIndex::Source> sources;
+            sources.reserve(paths.size());
+            for (const auto& path : paths)
+            {
+                std::ifstream ifs(path, std::ios::binary);
+                std::string data((std::istreambuf_iterator<char>(ifs)),
+                                 std::istreambuf_iterator<char>());
+                nlohmann::json json = nlohmann::json::parse(data, nullptr, false);
+                DatabaseIndex::Source source;
+                try
+                {
+                    source.core_name = json["CoreName"];
+                    source.core_sub_name = json["CoreSubName"];
+                    source.versioning = json["Versioning"];
+                    source.versioning_url = json["VersioningURL"];
+                    source.downloads = json["Downloads"].get<std::map<std::string, std::string>>();
+                    source.systems = hydra::split(json["SystemNames"], ',');
+                } catch (const std::exception&)
+                {
+                    log_warn(fmt::format("Invalid database file {}", path.string()).c_str());
+                    continue;
+                }
+
+                source.file_name = path.filename().string();
+                source.crc = mz_crc32(MZ_CRC32_INIT,
+                                        reinterpret_cast<const uint8_t*>(data.data()), data.size());
+                sources.push_back(std::move(source));
+            }
+
+            return hydra::write_file_atomic(get_index_path(), DatabaseIndex::Build(sources));
+        }
+
         static bool is_newer_date(const std::string& date_old, const std::string& date_new)
         {
             std::istringstream ss_old(date_old);
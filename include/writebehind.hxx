@@ -0,0 +1,131 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+
+namespace hydra
+{
+
+    // Writes to a temporary file next to path and renames it over path, so a crash or a full disk
+    // never leaves a truncated file behind. The temporary file is named after the thread, so two
+    // threads writing the same path never write into each other's temporary file
+    inline bool write_file_atomic(const std::filesystem::path& path, std::string_view data)
+    {
+        std::filesystem::path temp_path = path;
+        size_t thread_hash = std::hash<std::thread::id>()(std::this_thread::get_id());
+        temp_path += "." + std::to_string(thread_hash) + ".tmp";
+        {
+            std::ofstream ofs(temp_path, std::ios::binary | std::ios::trunc);
+            if (!ofs.good())
+            {
+                printf("Failed to open %s for writing\n", temp_path.string().c_str());
+                return false;
+            }
+            ofs.write(data.data(), data.size());
+            ofs.flush();
+            if (!ofs.good())
+            {
+                printf("Failed to write %s\n", temp_path.string().c_str());
+                return false;
+            }
+        }
+
+        std::error_code error;
+        std::filesystem::rename(temp_path, path, error);
+        if (error)
+        {
+            printf("Failed to rename %s: %s\n", temp_path.string().c_str(),
+                   error.message().c_str());
+            std::filesystem::remove(temp_path, error);
+            return false;
+        }
+        return true;
+    }
+
+    // Runs a write function on a background thread some time after the data was marked dirty.
+    // Everything marked dirty during the delay is coalesced into one write, and whatever is still
+    // dirty when the object is destroyed is written before the destructor returns
+    class WriteBehind
+    {
+    public:
+        WriteBehind(std::function<void()> write,
+                    std::chrono::milliseconds delay = std::chrono::milliseconds(500))
+            : write_(std::move(write)), delay_(delay), thread_(&WriteBehind::loop, this)
+        {
+        }
+
+        ~WriteBehind()
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                stop_ = true;
+            }
+            cv_.notify_all();
+            thread_.join();
+            Flush();
+        }
+
+        void MarkDirty()
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                dirty_ = true;
+            }
+            cv_.notify_all();
+        }
+
+        // Writes now if anything is dirty, on the calling thread
+        void Flush()
+        {
+            std::unique_lock<std::mutex> write_lock(write_mutex_);
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                if (!dirty_)
+                    return;
+                dirty_ = false;
+            }
+            write_();
+        }
+
+    private:
+        void loop()
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            while (!stop_)
+            {
+                cv_.wait(lock, [this]() { return dirty_ || stop_; });
+                // Give other changes a chance to pile up, the destructor flushes if we stop early
+                cv_.wait_for(lock, delay_, [this]() { return stop_; });
+                if (stop_)
+                    break;
+
+                lock.unlock();
+                Flush();
+                lock.lock();
+            }
+        }
+
+        std::function<void()> write_;
+        std::chrono::milliseconds delay_;
+        std::mutex mutex_;
+        // Serializes the writes themselves, so an explicit Flush can't overlap the background one
+        std::mutex write_mutex_;
+        std::condition_variable cv_;
+        bool dirty_ = false;
+        bool stop_ = false;
+        // Last, so everything above is initialized before the thread starts
+        std::thread thread_;
+
+        WriteBehind(const WriteBehind&) = delete;
+        WriteBehind& operator=(const WriteBehind&) = delete;
+    };
+
+} // namespace hydra
@@ -1,11 +1,17 @@
 #include "downloaderwindow.hxx"
 #include "download.hxx"
+#include "downloadmanager.hxx"
 #include "hsystem.hxx"
 #include "observer.hxx"
+#include "settings.hxx"
 #include "update.hxx"
+#include <atomic>
 #include <cstdint>
 #include <fmt/format.h>
+#include <functional>
 #include <future>
+#include <map>
+#include <memory>
 #include <QFuture>
 #include <QHBoxLayout>
 #include <QLabel>
@@ -16,11 +22,15 @@
 #include <QTextEdit>
 #include <QTreeWidget>
 #include <QVBoxLayout>
+#include <string_view>
 
+// One bar for every download the window started, filled by the bytes done out of the bytes known
+// so far
 class DownloadProgressBar : public QProgressBar, public hydra::Subject
 {
 public:
-    explicit DownloadProgressBar(QWidget* parent = nullptr) : QProgressBar(parent)
+    explicit DownloadProgressBar(hydra::DownloadManager* manager, QWidget* parent = nullptr)
+        : QProgressBar(parent), manager_(manager)
     {
         setMinimum(0);
         setMaximum(100);
@@ -28,50 +38,74 @@ public:
         setTextVisible(false);
     }
 
-    void Download(const std::string& url)
+    // Queues the download, finished is called on the GUI thread once it's installed or failed
+    void Download(const std::string& url, std::function<void(bool installed)> finished = nullptr)
     {
-        if (watcher_)
-        {
-            printf("Watcher already exists...?\n");
-            exit(1);
-        }
-
-        setMinimum(0);
-        setMaximum(0);
+        // Called on the download thread for every chunk, only changes in percentage are
+        // forwarded to the widget on the GUI thread
+        auto last_percent = std::make_shared<std::atomic<int>>(-1);
+        auto progress = [this, url, last_percent](uint64_t current, uint64_t total) {
+            int percent = total == 0 ? -1 : static_cast<int>((current * 100) / total);
+            if (percent == last_percent->exchange(percent))
+                return;
 
-        auto func = [this](uint64_t current, uint64_t total) {
-            return update_callback(current, total);
+            QMetaObject::invokeMethod(
+                this,
+                [this, url, current, total]() {
+                    auto it = downloads_.find(url);
+                    if (it != downloads_.end())
+                        it->second = {current, total};
+                    update_bar();
+                },
+                Qt::QueuedConnection);
         };
-        QFuture<hydra::HydraBufferWrapper> future =
-            QtConcurrent::run(hydra::Downloader::DownloadProgress, url, func);
-        watcher_ = new QFutureWatcher<hydra::HydraBufferWrapper>;
-        watcher_->setFuture(future);
-        connect(watcher_, &QFutureWatcher<hydra::HydraBufferWrapper>::finished, this,
-                &DownloadProgressBar::download_finished);
+        auto done = [this, url, finished](bool installed) {
+            QMetaObject::invokeMethod(
+                this,
+                [this, url, finished, installed]() {
+                    downloads_.erase(url);
+                    failed_ |= !installed;
+                    if (finished)
+                        finished(installed);
+                    update_bar();
+                    notify();
+                },
+                Qt::QueuedConnection);
+        };
+
+        if (!manager_->Enqueue(url, progress, done))
+            return;
+        if (downloads_.empty())
+            failed_ = false;
+        downloads_[url] = {0, 0};
+        update_bar();
         notify();
     }
 
-    bool IsDownloading() const
+    bool IsDownloading(const std::string& url) const
     {
-        return watcher_ != nullptr;
+        return downloads_.find(url) != downloads_.end();
     }
 
 private:
-    void download_finished()
+    void update_bar()
     {
-        hydra::Updater::InstallCore(watcher_->result());
-        watcher_->deleteLater();
-        watcher_ = nullptr;
         setMinimum(0);
-        setMaximum(100);
-        setValue(100);
-        notify();
-    }
+        if (downloads_.empty())
+        {
+            setMaximum(100);
+            setValue(failed_ ? 0 : 100);
+            return;
+        }
 
-    bool update_callback(uint64_t current, uint64_t total)
-    {
-        setMinimum(0);
-        if (current == 0 && total == 0)
+        uint64_t current = 0, total = 0;
+        for (const auto& [url, progress] : downloads_)
+        {
+            current += progress.first;
+            total += progress.second;
+        }
+
+        if (total == 0)
         {
             setMaximum(0);
         }
@@ -80,10 +114,12 @@ private:
             setMaximum(100);
             setValue((current * 100) / total);
         }
-        return true;
     }
 
-    QFutureWatcher<hydra::HydraBufferWrapper>* watcher_ = nullptr;
+    hydra::DownloadManager* manager_ = nullptr;
+    // Bytes done and total of each running download, by url
+    std::map<std::string, std::pair<uint64_t, uint64_t>> downloads_;
+    bool failed_ = false;
 };
 
 class DownloadButton : public QPushButton, public hydra::Observer
@@ -98,6 +134,7 @@ public:
         setMaximumWidth(100);
         setMaximumHeight(20);
         connect(this, &QPushButton::clicked, this, &DownloadButton::download_clicked);
+        subject_->attach(this);
     }
 
 private:
@@ -108,7 +145,7 @@ private:
 
     void update() override
     {
-        if (progress_bar_->IsDownloading())
+        if (progress_bar_->IsDownloading(url_))
         {
             setEnabled(false);
             setText("Downloading...");
@@ -135,21 +172,25 @@ DownloaderWindow::DownloaderWindow(QWidget* parent) : QWidget(parent, Qt::Window
     tree->setColumnCount(1);
 
     uint32_t minimum_size = 0;
-    auto database = hydra::Updater::GetDatabase();
-    DownloadProgressBar* bar = new DownloadProgressBar;
-    for (auto& [key, entries] : database)
+    std::unique_ptr<hydra::DatabaseIndex> database = hydra::Updater::GetDatabase();
+    size_t system_count = database ? database->SystemCount() : 0;
+    manager_ = std::make_unique<hydra::DownloadManager>();
+    progress_bar_ = new DownloadProgressBar(manager_.get());
+    DownloadProgressBar* bar = progress_bar_;
+    for (size_t i = 0; i < system_count; i++)
     {
         QTreeWidgetItem* item = new QTreeWidgetItem;
-        item->setText(0, QString::fromStdString(key));
+        item->setText(0, QString::fromUtf8(database->SystemName(i)));
         item->setChildIndicatorPolicy(QTreeWidgetItem::ShowIndicator);
         tree->addTopLevelItem(item);
-        for (auto& entry : entries)
+        for (size_t j = 0; j < database->EntryCount(i); j++)
         {
+            hydra::DatabaseIndex::Entry entry = database->GetEntry(i, j);
             QTreeWidgetItem* child = new QTreeWidgetItem;
             QWidget* widget = new QWidget;
             QHBoxLayout* layout = new QHBoxLayout;
-            QLabel* label =
-                new QLabel(QString::fromStdString(entry.CoreName + " " + entry.CoreSubName));
+            QLabel* label = new QLabel(QString::fromUtf8(entry.core_name) + " " +
+                                       QString::fromUtf8(entry.core_sub_name));
 
             layout->addWidget(label);
             widget->setLayout(layout);
@@ -160,17 +201,21 @@ DownloaderWindow::DownloaderWindow(QWidget* parent) : QWidget(parent, Qt::Window
             layout->addStretch();
 
             uint32_t icons_size = 0;
-            for (auto& [key, _] : entry.Downloads)
+            std::string url;
+            for (auto& download : entry.downloads)
             {
                 QLabel* label = new QLabel;
-                std::string os = key.substr(0, key.find_first_of(' '));
-                QString path = ":/images/" + QString::fromStdString(os) + ".png";
+                std::string_view os = download.os.substr(0, download.os.find_first_of(' '));
+                QString path = ":/images/" + QString::fromUtf8(os) + ".png";
                 label->setPixmap(QPixmap(path).scaled(16, 16, Qt::KeepAspectRatio));
                 layout->addWidget(label);
                 icons_size += 16;
+
+                if (download.os == hydra_os())
+                    url = download.url;
             }
 
-            DownloadButton* button = new DownloadButton(bar, entry.Downloads[hydra_os()]);
+            DownloadButton* button = new DownloadButton(bar, url);
             layout->addWidget(button);
 
             item->addChild(child);
@@ -181,10 +226,20 @@ DownloaderWindow::DownloaderWindow(QWidget* parent) : QWidget(parent, Qt::Window
                 minimum_size = new_size + 20;
         }
     }
+    // Everything shown was copied into the widgets, the mapping isn't needed past this point
+    database.reset();
+
+    update_button_ = new QPushButton("Update installed cores");
+    connect(update_button_, &QPushButton::clicked, this,
+            &DownloaderWindow::update_installed_cores);
+
+    QHBoxLayout* bottom_layout = new QHBoxLayout;
+    bottom_layout->addWidget(bar);
+    bottom_layout->addWidget(update_button_);
 
     QVBoxLayout* layout = new QVBoxLayout;
     layout->addWidget(tree);
-    layout->addWidget(bar);
+    layout->addLayout(bottom_layout);
     setLayout(layout);
 
     setMinimumSize(minimum_size + 100, 0);
@@ -193,4 +248,45 @@ DownloaderWindow::DownloaderWindow(QWidget* parent) : QWidget(parent, Qt::Window
     show();
 }
 
-DownloaderWindow::~DownloaderWindow() {}
+DownloaderWindow::~DownloaderWindow()
+{
+    // Cancels the downloads while the widgets they report to still exist
+    manager_.reset();
+}
+
+void DownloaderWindow::update_installed_cores()
+{
+    std::vector<std::string> core_names;
+    for (const auto& core : Settings::CoreInfo())
+        core_names.push_back(core.core_name);
+
+    update_button_->setEnabled(false);
+    update_button_->setText("Checking...");
+
+    auto* watcher = new QFutureWatcher<std::vector<hydra::Updater::CoreUpdate>>(this);
+    connect(watcher, &QFutureWatcher<std::vector<hydra::Updater::CoreUpdate>>::finished, this,
+            [this, watcher]() {
+                std::vector<hydra::Updater::CoreUpdate> updates = watcher->result();
+                watcher->deleteLater();
+
+                int queued = 0;
+                for (const auto& update : updates)
+                {
+                    if (update.status != hydra::Updater::UpdateAvailable || update.url.empty())
+                        continue;
+
+                    std::string key = update.core_name + "_date";
+                    std::string date = update.date;
+                    progress_bar_->Download(update.url, [key, date](bool installed) {
+                        if (installed && !date.empty())
+                            Settings::Set(key, date);
+                    });
+                    queued++;
+                }
+
+                update_button_->setEnabled(true);
+                update_button_->setText(queued ? QString("Updating %1 cores...").arg(queued)
+                                               : QString("Cores are up to date"));
+            });
+    watcher->setFuture(QtConcurrent::run(hydra::Updater::CheckCoreUpdates, core_names));
+}
@@ -1,13 +1,21 @@
 #pragma once
 
+#include <memory>
 #include <QWidget>
 #include <string>
 #include <vector>
 
+class DownloadProgressBar;
 class QProgressBar;
+class QPushButton;
 class QTextEdit;
 class QLabel;
 
+namespace hydra
+{
+    class DownloadManager;
+}
+
 class DownloaderWindow : public QWidget
 {
     Q_OBJECT
@@ -18,4 +26,9 @@ public:
 
 private:
     void download_core(const std::string& url);
+    void update_installed_cores();
+
+    std::unique_ptr<hydra::DownloadManager> manager_;
+    DownloadProgressBar* progress_bar_ = nullptr;
+    QPushButton* update_button_ = nullptr;
 };
\ No newline at end of file
@@ -1,11 +1,14 @@
 #define OPENSSL_API_COMPAT 10101
 #include "mainwindow.hxx"
 #include "aboutwindow.hxx"
+#include "cheatdb.hxx"
 #include "downloaderwindow.hxx"
 #include "input.hxx"
 #include "scripteditor.hxx"
 #include "settingswindow.hxx"
 #include "terminalwindow.hxx"
+#include <audiocallback.hxx>
+#include <cmath>
 #include <compatibility.hxx>
 #include <csignal>
 #include <error_factory.hxx>
@@ -16,13 +19,13 @@
 #include <json.hpp>
 #include <log.h>
 #include <mutex>
+#include <profiler.hxx>
 #include <QDesktopServices>
 #include <QFile>
 #include <QKeyEvent>
 #include <QKeySequence>
 #include <QMessageBox>
 #include <QtConcurrent/QtConcurrent>
-#include <QTimer>
 #include <settings.hxx>
 #ifdef HYDRA_USE_LUA
 #include <sol/sol.hpp>
@@ -41,18 +44,12 @@ std::atomic<EmulatorState> emulator_thread_state;
 
 MainWindow* main_window = nullptr;
 
+// Runs on the realtime audio thread, must not allocate, lock or otherwise block
 void hungry_for_more(ma_device* device, void* out, const void*, ma_uint32 frames)
 {
     MainWindow* window = static_cast<MainWindow*>(device->pUserData);
-    std::unique_lock<std::mutex> lock(window->audio_mutex_);
-    size_t frames_to_read =
-        std::min((size_t)frames * window->audio_frame_size_, window->audio_buffer_.size());
-    std::vector<int16_t> temp(frames_to_read / sizeof(int16_t));
-    window->audio_buffer_.read(temp.data(), frames_to_read);
-    for (size_t i = 0; i < temp.size(); i++)
-    {
-        ((int16_t*)out)[i] = temp[i];
-    }
+    hydra::fill_audio_device(window->audio_buffer_, out, (size_t)frames * window->audio_frame_size_,
+                             window->audio_reads_, window->audio_callback_worst_ns_);
 }
 
 void emulator_signal_handler(int signal)
@@ -105,10 +102,24 @@ MainWindow::MainWindow(QWidget* parent)
     screen_->show();
     layout->addWidget(screen_, Qt::AlignCenter);
 
+    load_progress_ = new QProgressBar(this);
+    load_progress_->setRange(0, load_stage_count);
+    load_progress_->setMaximumWidth(160);
+    load_progress_->hide();
+    load_cancel_ = new QPushButton(tr("Cancel"), this);
+    load_cancel_->hide();
+    connect(load_cancel_, &QPushButton::clicked, this, &MainWindow::cancel_load);
+    statusBar()->addPermanentWidget(load_progress_);
+    statusBar()->addPermanentWidget(load_cancel_);
+
     emulator_thread_state = EmulatorState::NOTRUNNING;
+    hydra::Profiler::SetThreadName("GUI");
     init_audio();
-    emulator_timer_ = new QTimer(this);
-    connect(emulator_timer_, SIGNAL(timeout()), this, SLOT(emulator_frame()));
+    volume_watcher_ = std::make_unique<hydra::SettingCallback>(
+        hydra::setting::master_volume, [this]() {
+            if (!mute_act_->isChecked())
+                set_volume(hydra::setting::master_volume.Get());
+        });
     enable_emulation_actions(false);
 
     QFuture<hydra::Updater::UpdateStatus> update_future =
@@ -120,6 +131,12 @@ MainWindow::MainWindow(QWidget* parent)
 
 MainWindow::~MainWindow()
 {
+    // Don't leave a core loading in the background while everything is torn down. Cancelled
+    // loads still run until their next stage, so they are waited on as well
+    for (QFutureWatcher<LoadedGame>* watcher : loads_)
+        watcher->cancel();
+    for (QFutureWatcher<LoadedGame>* watcher : loads_)
+        watcher->waitForFinished();
     stop_emulator();
 }
 
@@ -171,11 +188,9 @@ void MainWindow::init_audio(hydra::SampleType sample_type, hydra::ChannelType ch
     switch (sample_type)
     {
         case hydra::SampleType::Int16:
-            audio_frame_size_ = sizeof(int16_t);
             config.playback.format = ma_format_s16;
             break;
         case hydra::SampleType::Float:
-            audio_frame_size_ = sizeof(float);
             config.playback.format = ma_format_f32;
             break;
         default:
@@ -192,24 +207,54 @@ void MainWindow::init_audio(hydra::SampleType sample_type, hydra::ChannelType ch
         log_fatal("Failed to open audio device");
     }
 
+    // The device may not give us exactly what we asked for
+    audio_frame_size_ =
+        ma_get_bytes_per_frame(audio_device_->playback.format, audio_device_->playback.channels);
+
     ma_device_start(audio_device_.get());
 
-    std::string volume_str = Settings::Get("master_volume");
-    if (!volume_str.empty())
+    ma_device_set_master_volume(audio_device_.get(),
+                                hydra::setting::master_volume.Get() / 100.0f);
+}
+
+// Dynamic rate control, the resampling ratio is nudged by at most audio_max_rate_delta so that the
+// buffer hovers around the latency target. Small enough to be inaudible, large enough to absorb
+// the drift between the emulated clock and the audio device clock
+void MainWindow::resample(const void* input, size_t frames)
+{
+    double adjust = 1.0;
+    // When audio drives emulation the buffer level is already kept at the target
+    if (sync_mode_ != hydra::SyncMode::Audio)
     {
-        int volume = std::stoi(volume_str);
-        float volume_f = static_cast<float>(volume) / 100.0f;
-        ma_device_set_master_volume(audio_device_.get(), volume_f);
+        double fill = static_cast<double>(audio_buffer_.size()) / audio_target_bytes_;
+        adjust += audio_max_rate_delta * std::clamp(1.0 - fill, -1.0, 1.0);
     }
-    else
+    // One step is one part in audio_rate_out_, a few hundred steps across the whole window
+    uint32_t rate_in = std::max<long>(1, std::lround(audio_base_rate_in_ / adjust));
+    if (rate_in != audio_rate_in_)
     {
-        ma_device_set_master_volume(audio_device_.get(), 1.0f);
+        ma_resampler_set_rate(resampler_.get(), rate_in, audio_rate_out_);
+        audio_rate_in_ = rate_in;
     }
-}
 
-void MainWindow::resample(void*, const void*, size_t)
-{
-    printf("todo: resampling\n");
+    const uint8_t* in = static_cast<const uint8_t*>(input);
+    size_t frames_out_max = resample_buffer_.size() / audio_frame_size_;
+    while (frames > 0)
+    {
+        ma_uint64 frames_in = frames;
+        ma_uint64 frames_out = frames_out_max;
+        if (ma_resampler_process_pcm_frames(resampler_.get(), in, &frames_in,
+                                            resample_buffer_.data(), &frames_out) != MA_SUCCESS)
+        {
+            break;
+        }
+
+        audio_buffer_.write(resample_buffer_.data(), frames_out * audio_frame_size_);
+        if (frames_in == 0 && frames_out == 0)
+            break;
+        in += frames_in * audio_frame_size_;
+        frames -= frames_in;
+    }
 }
 
 void open_url(const std::filesystem::path& url)
@@ -302,6 +347,20 @@ void MainWindow::create_actions()
     cheats_act_->setCheckable(true);
     connect(cheats_act_, &QAction::triggered, this, &MainWindow::action_cheats);
 
+    import_cheats_act_ = new QAction(tr("&Import cheat database..."), this);
+    import_cheats_act_->setStatusTip("Import a cheat database covering many games");
+    connect(import_cheats_act_, &QAction::triggered, this, &MainWindow::action_import_cheats);
+
+    profiler_overlay_act_ = new QAction(tr("&Profiler overlay"), this);
+    profiler_overlay_act_->setShortcut(Qt::Key_F7);
+    profiler_overlay_act_->setStatusTip("Record frame timings and show them over the screen");
+    profiler_overlay_act_->setCheckable(true);
+    connect(profiler_overlay_act_, &QAction::triggered, this, &MainWindow::action_profiler_overlay);
+
+    export_trace_act_ = new QAction(tr("&Export trace..."), this);
+    export_trace_act_->setStatusTip("Save the recorded timings as a Chrome trace file");
+    connect(export_trace_act_, &QAction::triggered, this, &MainWindow::action_export_trace);
+
     recent_act_ = new QAction(tr("&Recent files"), this);
     for (int i = 0; i < 10; i++)
     {
@@ -339,17 +398,8 @@ void MainWindow::toggle_mute()
         }
         else
         {
-            std::string volume_str = Settings::Get("master_volume");
-            if (!volume_str.empty())
-            {
-                int volume = std::stoi(volume_str);
-                float volume_f = static_cast<float>(volume) / 100.0f;
-                ma_device_set_master_volume(audio_device_.get(), volume_f);
-            }
-            else
-            {
-                ma_device_set_master_volume(audio_device_.get(), 1.0f);
-            }
+            ma_device_set_master_volume(audio_device_.get(),
+                                        hydra::setting::master_volume.Get() / 100.0f);
         }
     }
 }
@@ -377,10 +427,14 @@ void MainWindow::create_menus()
     emulation_menu_->addAction(mute_act_);
     tools_menu_ = menuBar()->addMenu(tr("&Tools"));
     tools_menu_->addAction(cheats_act_);
+    tools_menu_->addAction(import_cheats_act_);
     tools_menu_->addAction(terminal_act_);
 #ifdef HYDRA_USE_LUA
     tools_menu_->addAction(scripts_act_);
 #endif
+    tools_menu_->addSeparator();
+    tools_menu_->addAction(profiler_overlay_act_);
+    tools_menu_->addAction(export_trace_act_);
     help_menu_ = menuBar()->addMenu(tr("&Help"));
     help_menu_->addAction(about_act_);
 }
@@ -392,7 +446,7 @@ void MainWindow::keyPressEvent(QKeyEvent* event)
     if (backwards_mappings_.find(event->key()) == backwards_mappings_.end())
         return;
     auto [player, key] = backwards_mappings_[event->key()];
-    input_state_[player][(int)key] = 1;
+    set_input(player, key, 1);
 }
 
 void MainWindow::keyReleaseEvent(QKeyEvent* event)
@@ -402,7 +456,15 @@ void MainWindow::keyReleaseEvent(QKeyEvent* event)
     if (backwards_mappings_.find(event->key()) == backwards_mappings_.end())
         return;
     auto [player, key] = backwards_mappings_[event->key()];
-    input_state_[player][(int)key] = 0;
+    set_input(player, key, 0);
+}
+
+void MainWindow::set_input(int player, hydra::ButtonType button, int32_t value)
+{
+    if (player < 0 || (uint32_t)player >= input_players_)
+        return;
+    input_state_[player * (int)hydra::ButtonType::InputCount + (int)button].store(
+        value, std::memory_order_relaxed);
 }
 
 void MainWindow::on_mouse_move(QMouseEvent*) {}
@@ -472,8 +534,6 @@ void MainWindow::open_file()
 
 void MainWindow::open_file_impl(const std::string& path)
 {
-    std::unique_lock<std::mutex> elock(emulator_mutex_);
-    emulator_timer_->stop();
     std::filesystem::path pathfs(path);
 
     if (!std::filesystem::is_regular_file(pathfs))
@@ -482,71 +542,96 @@ void MainWindow::open_file_impl(const std::string& path)
         return;
     }
 
-    stop_emulator();
-
     Settings::Set("last_path", pathfs.parent_path().string());
-    std::string core_path;
+    const EmulatorInfo* info = nullptr;
     for (const auto& core : Settings::CoreInfo())
     {
         for (const auto& ext : core.extensions)
         {
             if (pathfs.extension().string().substr(1) == ext)
             {
-                core_path = core.path;
+                info = &core;
                 break;
             }
         }
-        if (!core_path.empty())
+        if (info)
             break;
     }
-    if (core_path.empty())
+    if (!info)
     {
         log_warn(fmt::format("Failed to find core for file: {}", path).c_str());
         return;
     }
-    info_.reset();
-    for (auto& info : Settings::CoreInfo())
-    {
-        if (info.path == core_path)
-        {
-            info_ = std::make_unique<EmulatorInfo>(info);
-            break;
-        }
-    }
-    if (!info_)
-    {
-        log_warn(
-            fmt::format("Failed to find core info for core {}... This shouldn't happen?", core_path)
-                .c_str());
-    }
 
-    if (emulator_.use_count() != 0)
-        log_fatal("Emulator not reset properly?");
+    // Only one load at a time, the newest one wins
+    cancel_load();
+
+    LoadedGame game;
+    game.path = path;
+    game.info = *info;
+
+    // The running game keeps going while the new one loads, see load_finished
+    QFutureWatcher<LoadedGame>* watcher = new QFutureWatcher<LoadedGame>(this);
+    connect(watcher, &QFutureWatcher<LoadedGame>::progressValueChanged, load_progress_,
+            &QProgressBar::setValue);
+    connect(watcher, &QFutureWatcher<LoadedGame>::progressTextChanged, this,
+            [this](const QString& text) { statusBar()->showMessage(text); });
+    connect(watcher, &QFutureWatcher<LoadedGame>::finished, this,
+            [this, watcher]() { load_finished(watcher); });
+    load_watcher_ = watcher;
+    loads_.push_back(watcher);
+    load_progress_->setValue(0);
+    load_progress_->show();
+    load_cancel_->show();
+    watcher->setFuture(QtConcurrent::run(&MainWindow::load_game, std::move(game)));
+}
 
-    emulator_ = hydra::EmulatorFactory::Create(core_path);
-    if (!emulator_)
-        throw ErrorFactory::generate_exception(__func__, __LINE__, "Failed to create emulator");
-    init_emulator();
-    if (!emulator_->LoadGame(pathfs))
-        throw ErrorFactory::generate_exception(__func__, __LINE__, "Failed to open file");
-    enable_emulation_actions(true);
-    add_recent(path);
+void MainWindow::cancel_load()
+{
+    if (!load_watcher_)
+        return;
 
-    // Find mappings
-    backwards_mappings_.clear();
-    input_state_.clear();
+    // The worker stops at the next stage, load_finished throws away whatever it got to
+    load_watcher_->cancel();
+    load_watcher_ = nullptr;
+    load_progress_->hide();
+    load_cancel_->hide();
+    statusBar()->showMessage(tr("Loading cancelled"));
+}
 
-    uint32_t max_players = 1;
-    if (emulator_->shell->hasInterface(hydra::InterfaceType::IMultiplayer))
+void MainWindow::load_game(QPromise<LoadedGame>& promise, LoadedGame game)
+{
+    HYDRA_PROFILE_SCOPE("Load game");
+    promise.setProgressRange(0, load_stage_count);
+    auto next_stage = [&promise](int stage, const QString& text) {
+        promise.setProgressValueAndText(stage, text);
+        return !promise.isCanceled();
+    };
+    auto fail = [&promise, &game](const std::string& error) {
+        game.emulator.reset();
+        game.error = error;
+        promise.addResult(std::move(game));
+    };
+
+    if (!next_stage(0, tr("Loading core %1...").arg(game.info.core_name.c_str())))
+        return;
+    game.emulator = hydra::EmulatorFactory::Create(game.info.path);
+    if (!game.emulator || !game.emulator->shell)
+        return fail(fmt::format("Failed to create emulator from {}", game.info.path));
+    if (!game.emulator->shell->hasInterface(hydra::InterfaceType::IBase))
+        return fail(fmt::format("Core {} has no base interface", game.info.core_name));
+    connect_emulator(game.emulator.get());
+
+    if (!next_stage(1, tr("Reading mappings...")))
+        return;
+    if (game.emulator->shell->hasInterface(hydra::InterfaceType::IMultiplayer))
     {
-        auto multiplayer = emulator_->shell->asIMultiplayer();
-        max_players = multiplayer->getMaximumPlayerCount();
+        game.max_players = game.emulator->shell->asIMultiplayer()->getMaximumPlayerCount();
     }
-    input_state_.resize(max_players);
 
-    for (uint32_t i = 1; i < max_players + 1; i++)
+    for (uint32_t i = 1; i < game.max_players + 1; i++)
     {
-        std::string setting = info_->core_name + "_" + std::to_string(i) + "_mapping";
+        std::string setting = game.info.core_name + "_" + std::to_string(i) + "_mapping";
         std::string mapping = Settings::Get(setting);
         hydra::KeyMappings keys;
 
@@ -565,12 +650,99 @@ void MainWindow::open_file_impl(const std::string& path)
 
         for (int j = 0; j < (int)hydra::ButtonType::InputCount; j++)
         {
-            backwards_mappings_[keys[j][0].key()] = {i - 1, (hydra::ButtonType)j};
+            game.backwards_mappings[keys[j][0].key()] = {i - 1, (hydra::ButtonType)j};
         }
     }
 
+    if (game.emulator->shell->hasInterface(hydra::InterfaceType::IOpenGlRendered))
+    {
+        game.needs_gui_load = true;
+        promise.addResult(std::move(game));
+        return;
+    }
+
+    if (!next_stage(2, tr("Loading %1...")
+                           .arg(std::filesystem::path(game.path).filename().string().c_str())))
+        return;
+    std::string error = load_game_files(game);
+    if (!error.empty())
+        return fail(error);
+
+    if (!next_stage(load_stage_count, tr("Starting...")))
+        return;
+    promise.addResult(std::move(game));
+}
+
+std::string MainWindow::load_game_files(LoadedGame& game)
+{
+    for (const auto& file : game.info.firmware_files)
+    {
+        std::string path = Settings::Get(game.info.core_name + "_" + file);
+        if (path.empty())
+            return fmt::format("Firmware file {} not set in settings", file);
+        game.emulator->shell->loadFile(file.c_str(), path.c_str());
+    }
+
+    if (!game.emulator->LoadGame(game.path))
+        return fmt::format("Failed to open file: {}", game.path);
+    return {};
+}
+
+void MainWindow::load_finished(QFutureWatcher<LoadedGame>* watcher)
+{
+    watcher->deleteLater();
+    loads_.erase(std::remove(loads_.begin(), loads_.end(), watcher), loads_.end());
+    // Cancelled or replaced by a newer load
+    if (watcher != load_watcher_)
+        return;
+    load_watcher_ = nullptr;
+    load_progress_->hide();
+    load_cancel_->hide();
+    if (watcher->future().resultCount() == 0)
+        return;
+
+    LoadedGame game = watcher->result();
+    if (!game.error.empty())
+    {
+        log_warn(game.error.c_str());
+        statusBar()->showMessage(QString::fromStdString(game.error));
+        return;
+    }
+
+    // The previous game only stops now that the new one is ready, so the screen is blank for as
+    // short as possible. Must happen before locking, the emulator thread needs the lock to finish
+    // its frame
+    stop_emulator_thread();
+    std::unique_lock<std::mutex> elock(emulator_mutex_);
+    stop_emulator();
+
+    emulator_ = game.emulator;
+    info_ = std::make_unique<EmulatorInfo>(game.info);
+    init_emulator();
+    if (game.needs_gui_load)
+    {
+        std::string error = load_game_files(game);
+        if (!error.empty())
+        {
+            log_warn(error.c_str());
+            statusBar()->showMessage(QString::fromStdString(error));
+            stop_emulator();
+            return;
+        }
+    }
+    enable_emulation_actions(true);
+    add_recent(game.path);
+    statusBar()->showMessage(
+        tr("Loaded %1").arg(std::filesystem::path(game.path).filename().string().c_str()));
+
+    backwards_mappings_ = std::move(game.backwards_mappings);
+    // The emulator thread is stopped, so nothing reads the old state anymore
+    input_players_ = game.max_players;
+    input_state_ = std::make_unique<std::atomic<int32_t>[]>(
+        input_players_ * (int)hydra::ButtonType::InputCount);
+
     paused_ = false;
-    emulator_timer_->start();
+    start_emulator_thread();
 }
 
 void MainWindow::reset_emulator_windows()
@@ -586,9 +758,7 @@ void MainWindow::action_settings()
     {
         windows_[WindowIndex::Settings].reset();
     }
-    using namespace std::placeholders;
-    windows_[WindowIndex::Settings] =
-        std::make_unique<SettingsWindow>(std::bind(&MainWindow::set_volume, this, _1), this);
+    windows_[WindowIndex::Settings] = std::make_unique<SettingsWindow>(this);
 }
 
 void MainWindow::action_download_cores()
@@ -638,12 +808,72 @@ void MainWindow::action_cheats()
     }
     else
     {
-        std::filesystem::path path = Settings::GetSavePath() / "cheats" / (game_hash_ + ".json");
+        std::filesystem::path path =
+            Settings::GetSavePath() / "cheats" / (emulator_->GetGameHash() + ".json");
         windows_[WindowIndex::Cheats] =
             std::make_unique<CheatsWindow>(emulator_, path, cheats_act_, this);
     }
 }
 
+void MainWindow::action_import_cheats()
+{
+    QString path = QFileDialog::getOpenFileName(this, tr("Import cheat database"), "",
+                                                tr("Cheat databases (*.json)"));
+    if (path.isEmpty())
+        return;
+
+    statusBar()->showMessage(tr("Importing cheats..."));
+    QFutureWatcher<size_t>* watcher = new QFutureWatcher<size_t>(this);
+    connect(watcher, &QFutureWatcher<size_t>::finished, this, [this, watcher]() {
+        watcher->deleteLater();
+        size_t games = watcher->result();
+        statusBar()->showMessage(tr("Imported cheats for %1 games").arg(games));
+        if (games == 0 || !emulator_ ||
+            !emulator_->shell->hasInterface(hydra::InterfaceType::ICheat))
+            return;
+
+        // The running game picks up its entries right away, the others when they are loaded
+        size_t merged;
+        {
+            std::unique_lock<std::mutex> elock(emulator_mutex_);
+            merged = emulator_->MergeCheatDatabase();
+        }
+        if (merged != 0 && windows_[WindowIndex::Cheats])
+        {
+            bool visible = windows_[WindowIndex::Cheats]->isVisible();
+            windows_[WindowIndex::Cheats].reset();
+            if (visible)
+                action_cheats();
+        }
+    });
+    watcher->setFuture(QtConcurrent::run(
+        [path]() { return hydra::CheatDatabase::Import(path.toStdString()); }));
+}
+
+void MainWindow::action_profiler_overlay()
+{
+    bool enabled = profiler_overlay_act_->isChecked();
+    hydra::Profiler::SetEnabled(enabled);
+    screen_->overlay_ = enabled;
+    screen_->update();
+}
+
+void MainWindow::action_export_trace()
+{
+    QString path = QFileDialog::getSaveFileName(this, tr("Export trace"), "hydra_trace.json",
+                                                tr("Trace files (*.json)"));
+    if (path.isEmpty())
+        return;
+
+    std::ofstream file(path.toStdString(), std::ios::binary);
+    if (!file.is_open())
+    {
+        log_warn(fmt::format("Failed to open {} for writing", path.toStdString()).c_str());
+        return;
+    }
+    file << hydra::Profiler::ExportChromeTrace();
+}
+
 // TODO: compiler option to turn off lua support
 void MainWindow::run_script(const std::string& script, bool safe_mode)
 {
@@ -763,11 +993,11 @@ void MainWindow::pause_emulator()
     paused_ = !paused_;
     if (paused_)
     {
-        emulator_timer_->stop();
+        stop_emulator_thread();
     }
     else
     {
-        emulator_timer_->start();
+        start_emulator_thread();
     }
 }
 
@@ -775,7 +1005,9 @@ void MainWindow::reset_emulator()
 {
     if (emulator_)
     {
-        std::unique_lock<std::mutex> alock(audio_mutex_);
+        // The audio callback does the actual discarding the next time it runs, it owns the read
+        // side of the buffer
+        std::unique_lock<std::mutex> elock(emulator_mutex_);
         audio_buffer_.clear();
         emulator_->shell->asIBase()->reset();
     }
@@ -788,7 +1020,10 @@ fptr get_proc_address(const char* name)
     return QOpenGLContext::currentContext()->getProcAddress(name);
 }
 
-void poll_input_callback() {}
+void poll_input_callback()
+{
+    HYDRA_PROFILE_SCOPE("Input poll");
+}
 
 void MainWindow::init_emulator()
 {
@@ -806,6 +1041,7 @@ void MainWindow::init_emulator()
     if (emulator_->shell->hasInterface(hydra::InterfaceType::IOpenGlRendered))
     {
         hydra::IOpenGlRendered* shell_gl = emulator_->shell->asIOpenGlRendered();
+        screen_->flip_ = false;
         shell_gl->setGetProcAddress((void*)get_proc_address);
         shell_gl->resetContext();
         // TODO: tf so ugly
@@ -824,15 +1060,13 @@ void MainWindow::init_emulator()
     // Initialize sw
     if (emulator_->shell->hasInterface(hydra::InterfaceType::ISoftwareRendered))
     {
-        hydra::ISoftwareRendered* shell_sw = emulator_->shell->asISoftwareRendered();
-        shell_sw->setVideoCallback(video_callback);
+        screen_->flip_ = true;
     }
 
     // Initialize audio
     if (emulator_->shell->hasInterface(hydra::InterfaceType::IAudio))
     {
         hydra::IAudio* shell_audio = emulator_->shell->asIAudio();
-        shell_audio->setAudioCallback(audio_callback);
         hydra::SampleType sample_type = shell_audio->getSampleType();
         hydra::ChannelType channel_type = shell_audio->getChannelType();
         uint32_t sample_rate = shell_audio->getSampleRate();
@@ -847,41 +1081,34 @@ void MainWindow::init_emulator()
 
         resampler_.reset();
 
-        if (audio_device_->sampleRate != sample_rate)
+        // Always resample, even at matching rates the two clocks drift apart
+        ma_resampler_config config = ma_resampler_config_init(
+            format, channel, sample_rate, audio_device_->sampleRate, ma_resample_algorithm_linear);
+        std::string quality = hydra::setting::audio_resample_quality.Get();
+        if (quality == "low")
+            config.linear.lpfOrder = 0;
+        else if (quality == "high")
+            config.linear.lpfOrder = MA_MAX_FILTER_ORDER;
+        resampler_.reset(new ma_resampler);
+        if (ma_resampler_init(&config, nullptr, resampler_.get()) != MA_SUCCESS)
         {
-            ma_resampler_config config =
-                ma_resampler_config_init(format, channel, sample_rate, audio_device_->sampleRate,
-                                         ma_resample_algorithm_linear);
-            resampler_.reset(new ma_resampler);
-            if (ma_resampler_init(&config, nullptr, resampler_.get()) != MA_SUCCESS)
-            {
-                log_fatal("Failed to initialize resampler");
-            }
+            log_fatal("Failed to initialize resampler");
         }
+        audio_rate_out_ = audio_device_->sampleRate;
+        while (audio_rate_out_ > 0xFFFF)
+            audio_rate_out_ /= 2;
+        audio_base_rate_in_ =
+            static_cast<double>(sample_rate) * audio_rate_out_ / audio_device_->sampleRate;
+        audio_rate_in_ = 0;
+
+        int latency_ms = std::clamp(hydra::setting::audio_latency_ms.Get(), 8, 500);
+        audio_target_bytes_ = std::min<size_t>(static_cast<size_t>(audio_device_->sampleRate) *
+                                                   latency_ms / 1000 * audio_frame_size_,
+                                               audio_buffer_.capacity() / 2);
+        resample_buffer_.resize(resample_chunk_frames * audio_frame_size_);
     }
 
-    // Initialize input
-    if (emulator_->shell->hasInterface(hydra::InterfaceType::IInput))
-    {
-        hydra::IInput* shell_input = emulator_->shell->asIInput();
-        shell_input->setPollInputCallback(poll_input_callback);
-        shell_input->setCheckButtonCallback(read_input_callback);
-    }
-
-    // Initialize logging
-    if (emulator_->shell->hasInterface(hydra::InterfaceType::ILog))
-    {
-        hydra::ILog* shell_log = emulator_->shell->asILog();
-        shell_log->setLogCallback(hydra::LogTarget::Warning, TerminalWindow::log_warn);
-        shell_log->setLogCallback(hydra::LogTarget::Info, TerminalWindow::log_info);
-        shell_log->setLogCallback(hydra::LogTarget::Debug, TerminalWindow::log_debug);
-        shell_log->setLogCallback(hydra::LogTarget::Error, log_fatal);
-        terminal_act_->setEnabled(true);
-    }
-    else
-    {
-        terminal_act_->setEnabled(false);
-    }
+    terminal_act_->setEnabled(emulator_->shell->hasInterface(hydra::InterfaceType::ILog));
 
     // Initialize cheats
     if (emulator_->shell->hasInterface(hydra::InterfaceType::ICheat))
@@ -898,98 +1125,255 @@ void MainWindow::init_emulator()
         printf("Warning: self driven cores are not supported currently and the API for them is "
                "bound to change");
     }
+}
 
-    // Initialize firmware
-    std::vector<std::string> firmware_files = info_->firmware_files;
-    for (const auto& file : firmware_files)
+// Only installs callbacks, so it's safe to call on a worker thread while another game is running
+void MainWindow::connect_emulator(hydra::EmulatorWrapper* emulator)
+{
+    hydra::IBase* shell = emulator->shell;
+    if (shell->hasInterface(hydra::InterfaceType::ISoftwareRendered))
     {
-        std::string core_name = info_->core_name;
-        std::string path = Settings::Get(core_name + "_" + file);
-        if (path.empty())
-        {
-            log_fatal(fmt::format("Firmware file {} not set in settings", file).c_str());
-        }
-        emulator_->shell->loadFile(file.c_str(), path.c_str());
+        shell->asISoftwareRendered()->setVideoCallback(video_callback);
+    }
+
+    if (shell->hasInterface(hydra::InterfaceType::IAudio))
+    {
+        shell->asIAudio()->setAudioCallback(audio_callback);
+    }
+
+    if (shell->hasInterface(hydra::InterfaceType::IInput))
+    {
+        hydra::IInput* shell_input = shell->asIInput();
+        shell_input->setPollInputCallback(poll_input_callback);
+        shell_input->setCheckButtonCallback(read_input_callback);
+    }
+
+    if (shell->hasInterface(hydra::InterfaceType::ILog))
+    {
+        hydra::ILog* shell_log = shell->asILog();
+        shell_log->setLogCallback(hydra::LogTarget::Warning, TerminalWindow::log_warn);
+        shell_log->setLogCallback(hydra::LogTarget::Info, TerminalWindow::log_info);
+        shell_log->setLogCallback(hydra::LogTarget::Debug, TerminalWindow::log_debug);
+        shell_log->setLogCallback(hydra::LogTarget::Error, log_fatal);
     }
 }
 
 void MainWindow::stop_emulator()
 {
+    stop_emulator_thread();
     if (emulator_)
     {
-        std::unique_lock<std::mutex> alock(audio_mutex_);
+        log_info(fmt::format("Audio buffer: {} underruns, {} overruns, worst callback time {}us",
+                             audio_buffer_.underruns(), audio_buffer_.overruns(),
+                             audio_callback_worst_ns_.load() / 1000)
+                     .c_str());
+        audio_buffer_.clear();
+        audio_buffer_.reset_stats();
+        audio_callback_worst_ns_ = 0;
+        uint64_t presented = frames_presented_.exchange(0);
+        uint64_t copies = frame_copies_.exchange(0) + screen_->frames_copied_;
+        screen_->frames_copied_ = 0;
+        if (presented != 0)
+        {
+            log_info(fmt::format("Video: {} frames presented, {:.2f} frame copies per frame",
+                                 presented, static_cast<double>(copies) / presented)
+                         .c_str());
+        }
         reset_emulator_windows();
         emulator_.reset();
-        std::fill(video_buffer_.begin(), video_buffer_.end(), 0);
         enable_emulation_actions(false);
     }
 }
 
-// TODO: check if frontend driven core
-void MainWindow::emulator_frame()
+void MainWindow::start_emulator_thread()
 {
-    std::unique_lock<std::mutex> elock(emulator_mutex_);
-    frame_count_++;
-    if (emulator_->shell->hasInterface(hydra::InterfaceType::IOpenGlRendered))
+    if (!emulator_ || emulator_thread_.joinable())
+        return;
+
+    gl_rendered_ = emulator_->shell->hasInterface(hydra::InterfaceType::IOpenGlRendered);
+    hydra::LagPolicy policy = hydra::setting::frame_lag_policy.Get() == "skip"
+                                  ? hydra::LagPolicy::Skip
+                                  : hydra::LagPolicy::CatchUp;
+    scheduler_.Reset(emulator_->shell->asIFrontendDriven()->getFps(), policy);
+    sync_mode_ = hydra::sync_mode_from_string(hydra::setting::sync_mode_override.empty()
+                                                  ? hydra::setting::sync_mode.Get()
+                                                  : hydra::setting::sync_mode_override);
+    if (sync_mode_ == hydra::SyncMode::Audio &&
+        !emulator_->shell->hasInterface(hydra::InterfaceType::IAudio))
     {
-        hydra::IOpenGlRendered* shell_gl = emulator_->shell->asIOpenGlRendered();
-        shell_gl->setFbo(screen_->GetFbo());
-        auto size = emulator_->shell->getNativeSize();
-        screen_->Resize(size.width, size.height);
+        log_warn("Core has no audio, falling back to video sync");
+        sync_mode_ = hydra::SyncMode::Video;
+    }
+    emulator_thread_state = EmulatorState::RUNNING;
+    emulator_thread_ = std::thread(&MainWindow::emulator_loop, this);
+}
+
+void MainWindow::stop_emulator_thread()
+{
+    if (!emulator_thread_.joinable())
+        return;
+
+    {
+        std::unique_lock<std::mutex> lock(gl_frame_mutex_);
+        emulator_thread_state = EmulatorState::STOP;
     }
-    else if (emulator_->shell->hasInterface(hydra::InterfaceType::ISoftwareRendered))
+    gl_frame_cv_.notify_all();
+    audio_reads_.fetch_add(1);
+    audio_reads_.notify_all();
+
+    // Can happen when the signal handler fires inside a core
+    if (std::this_thread::get_id() == emulator_thread_.get_id())
     {
-        // TODO: rename variables to something more meaningful
-        screen_->Resize(video_width_, video_height_);
-        screen_->Redraw(video_buffer_.data());
+        emulator_thread_.detach();
     }
-    emulator_->shell->asIFrontendDriven()->runFrame();
-    screen_->update();
-    std::this_thread::sleep_for(std::chrono::milliseconds(sleep_time_));
-    if (frame_count_ >= emulator_->shell->asIFrontendDriven()->getFps())
-    {
-        frame_count_ = 0;
-        // Check how many ms elapsed
-        auto now = std::chrono::high_resolution_clock::now();
-        auto elapsed =
-            std::chrono::duration_cast<std::chrono::milliseconds>(now - last_emulation_second_time_)
-                .count();
-        if (elapsed > 1100)
+    else
+    {
+        emulator_thread_.join();
+    }
+    emulator_thread_state = EmulatorState::NOTRUNNING;
+}
+
+// TODO: check if frontend driven core
+void MainWindow::emulator_loop()
+{
+    hydra::Profiler::SetThreadName("Emulator");
+    while (emulator_thread_state == EmulatorState::RUNNING)
+    {
+        uint32_t frames = 1;
+        switch (sync_mode_)
         {
-            sleep_time_ -= 1;
+            case hydra::SyncMode::Video:
+                frames = scheduler_.Wait();
+                break;
+            case hydra::SyncMode::Audio:
+                wait_for_audio();
+                break;
+            case hydra::SyncMode::FreeRun:
+                break;
         }
-        else if (elapsed < 900)
+        for (uint32_t i = 0; i < frames && emulator_thread_state == EmulatorState::RUNNING; i++)
         {
-            sleep_time_ += 1;
+            if (gl_rendered_)
+            {
+                std::unique_lock<std::mutex> lock(gl_frame_mutex_);
+                gl_frame_done_ = false;
+                QMetaObject::invokeMethod(this, &MainWindow::run_gl_frame, Qt::QueuedConnection);
+                gl_frame_cv_.wait(lock, [this]() {
+                    return gl_frame_done_ || emulator_thread_state != EmulatorState::RUNNING;
+                });
+            }
+            else
+            {
+                std::unique_lock<std::mutex> elock(emulator_mutex_);
+                std::unique_lock<std::mutex> core_lock = emulator_->LockCore();
+                HYDRA_PROFILE_SCOPE("Run frame");
+                emulator_->shell->asIFrontendDriven()->runFrame();
+            }
+        }
+
+        // Only hand the newest finished frame to the GUI, if it hasn't picked up the last one
+        // yet it will get this one instead
+        if (frame_written_)
+        {
+            frame_written_ = false;
+            frame_pool_.Publish();
+            if (!frame_pending_.exchange(true))
+            {
+                QMetaObject::invokeMethod(this, &MainWindow::present_frame,
+                                          Qt::QueuedConnection);
+            }
+        }
+    }
+    emulator_thread_state = EmulatorState::STOPPED;
+}
+
+void MainWindow::wait_for_audio()
+{
+    uint32_t reads = audio_reads_.load(std::memory_order_acquire);
+    while (audio_buffer_.size() >= audio_target_bytes_ &&
+           emulator_thread_state == EmulatorState::RUNNING)
+    {
+        audio_reads_.wait(reads, std::memory_order_acquire);
+        reads = audio_reads_.load(std::memory_order_acquire);
+    }
+}
+
+void MainWindow::run_gl_frame()
+{
+    {
+        std::unique_lock<std::mutex> elock(emulator_mutex_);
+        if (emulator_ && emulator_thread_state == EmulatorState::RUNNING)
+        {
+            hydra::IOpenGlRendered* shell_gl = emulator_->shell->asIOpenGlRendered();
+            shell_gl->setFbo(screen_->GetFbo());
+            auto size = emulator_->shell->getNativeSize();
+            screen_->Resize(size.width, size.height);
+            std::unique_lock<std::mutex> core_lock = emulator_->LockCore();
+            HYDRA_PROFILE_SCOPE("Run frame");
+            emulator_->shell->asIFrontendDriven()->runFrame();
+            screen_->update();
         }
-        last_emulation_second_time_ = std::chrono::high_resolution_clock::now();
     }
+
+    {
+        std::unique_lock<std::mutex> lock(gl_frame_mutex_);
+        gl_frame_done_ = true;
+    }
+    gl_frame_cv_.notify_all();
+}
+
+void MainWindow::present_frame()
+{
+    frame_pending_ = false;
+    hydra::FramePool::Slot* frame = frame_pool_.Acquire();
+    if (!frame || frame->data.empty())
+        return;
+
+    screen_->Resize(frame->width, frame->height);
+    screen_->Redraw(frame->data.data());
+    frames_presented_++;
 }
 
 void MainWindow::video_callback(void* data, hydra::Size size)
 {
-    main_window->video_width_ = size.width;
-    main_window->video_height_ = size.height;
+    // Called from runFrame on the emulator thread, the copy goes straight into the next free slot
+    // and the slot itself is what ends up being presented
+    HYDRA_PROFILE_SCOPE("Video callback");
     if (data)
     {
-        main_window->video_buffer_.resize(size.width * size.height * 4);
-        std::memcpy(main_window->video_buffer_.data(), data, main_window->video_buffer_.size());
+        hydra::FramePool::Slot& slot = main_window->frame_pool_.WriteSlot();
+        slot.width = size.width;
+        slot.height = size.height;
+        slot.data.resize(size.width * size.height * 4);
+        std::memcpy(slot.data.data(), data, slot.data.size());
+        main_window->frame_copies_.fetch_add(1, std::memory_order_relaxed);
+        main_window->frame_written_ = true;
     }
 }
 
 void MainWindow::audio_callback(void* data, size_t frames)
 {
-    std::unique_lock<std::mutex> lock(main_window->audio_mutex_);
-    main_window->audio_buffer_.write(data, frames * main_window->audio_frame_size_);
+    HYDRA_PROFILE_SCOPE("Audio push");
+    if (main_window->resampler_)
+    {
+        main_window->resample(data, frames);
+    }
+    else
+    {
+        main_window->audio_buffer_.write(data, frames * main_window->audio_frame_size_);
+    }
 }
 
 int32_t MainWindow::read_input_callback(uint32_t player, hydra::ButtonType button)
 {
     // TODO: is there such a thing as multiplayer touch?
     if (button == hydra::ButtonType::Touch)
-        return main_window->mouse_state_;
+        return main_window->mouse_state_.load(std::memory_order_relaxed);
 
-    return main_window->input_state_[player][(int)button];
+    if (player >= main_window->input_players_)
+        return 0;
+    return main_window->input_state_[player * (int)hydra::ButtonType::InputCount + (int)button]
+        .load(std::memory_order_relaxed);
 }
 
 void MainWindow::add_recent(const std::string& path)
@@ -1,10 +1,14 @@
 #pragma once
 
+#include "framepool.hxx"
+#include "framescheduler.hxx"
 #include "ringbuffer.hxx"
 #include "screenwidget.hxx"
 #include "settings.hxx"
 #include "update.hxx"
 #include <array>
+#include <atomic>
+#include <condition_variable>
 #include <deque>
 #include <hydra/core.hxx>
 #include <memory>
@@ -18,16 +22,36 @@
 #include <QLabel>
 #include <QMainWindow>
 #include <QMenuBar>
+#include <QProgressBar>
+#include <QPromise>
+#include <QPushButton>
 #include <QStatusBar>
 #include <QVBoxLayout>
 #include <thread>
 #include <unordered_map>
+#include <vector>
 
 class MainWindow : public QMainWindow
 {
     Q_OBJECT
 
 private:
+    // Everything needed to start a game that can be prepared without stopping the running one
+    struct LoadedGame
+    {
+        std::string path;
+        EmulatorInfo info;
+        std::shared_ptr<hydra::EmulatorWrapper> emulator;
+        // OpenGL cores may touch the widget's context while loading, so their firmware and game
+        // are loaded on the GUI thread once the running game is stopped
+        bool needs_gui_load = false;
+        uint32_t max_players = 1;
+        std::unordered_map<int, std::pair<int, hydra::ButtonType>> backwards_mappings;
+        std::string error;
+    };
+
+    static constexpr int load_stage_count = 3;
+
     void keyPressEvent(QKeyEvent* event) override;
     void keyReleaseEvent(QKeyEvent* event) override;
 
@@ -38,12 +62,17 @@ private:
     // Menu bar actions
     void open_file();
     void open_file_impl(const std::string& file);
+    void cancel_load();
+    void load_finished(QFutureWatcher<LoadedGame>* watcher);
     void action_settings();
     void action_download_cores();
     void action_about();
     void action_scripts();
     void action_terminal();
     void action_cheats();
+    void action_import_cheats();
+    void action_profiler_overlay();
+    void action_export_trace();
     void run_script(const std::string& script, bool safe_mode);
     void screenshot();
     void add_recent(const std::string& path);
@@ -52,12 +81,21 @@ private:
     void pause_emulator();
     void reset_emulator();
     void init_emulator();
+    static void connect_emulator(hydra::EmulatorWrapper* emulator);
+    static void load_game(QPromise<LoadedGame>& promise, LoadedGame game);
+    static std::string load_game_files(LoadedGame& game);
     void stop_emulator();
+    void start_emulator_thread();
+    void stop_emulator_thread();
+    void emulator_loop();
+    void wait_for_audio();
+    void run_gl_frame();
+    void present_frame();
     void enable_emulation_actions(bool should);
     void init_audio(hydra::SampleType sample_type = hydra::SampleType::Int16,
                     hydra::ChannelType channel_type = hydra::ChannelType::Stereo);
     void set_volume(int volume);
-    void resample(void* output, const void* input, size_t frames);
+    void resample(const void* input, size_t frames);
     void update_recent_files();
     void update_fbo(unsigned fbo);
     void reset_emulator_windows();
@@ -66,12 +104,12 @@ private:
     static void video_callback(void* data, hydra::Size size);
     static void audio_callback(void* data, size_t frames);
     static int32_t read_input_callback(uint32_t player, hydra::ButtonType button);
+    void set_input(int player, hydra::ButtonType button, int32_t value);
 
 private slots:
     void on_mouse_move(QMouseEvent* event);
     void on_mouse_click(QMouseEvent* event);
     void on_mouse_release(QMouseEvent* event);
-    void emulator_frame();
     void update_check_finished();
     void toggle_mute();
 
@@ -113,44 +151,82 @@ private:
     QAction* screenshot_act_;
     QAction* scripts_act_;
     QAction* cheats_act_;
+    QAction* import_cheats_act_;
     QAction* terminal_act_;
+    QAction* profiler_overlay_act_;
+    QAction* export_trace_act_;
     QAction* recent_act_;
-    QTimer* emulator_timer_;
     ScreenWidget* screen_;
+    QProgressBar* load_progress_;
+    QPushButton* load_cancel_;
+    // The load in flight, if any. Replaced or cleared when a load is cancelled, so results from
+    // any other watcher are stale
+    QFutureWatcher<LoadedGame>* load_watcher_ = nullptr;
+    // Every load that hasn't finished yet, cancelled ones included, they keep running until their
+    // next stage
+    std::vector<QFutureWatcher<LoadedGame>*> loads_;
 
     // Common
     std::mutex emulator_mutex_;
-    std::mutex audio_mutex_;
-    int frame_count_ = 0;
-    int sleep_time_ = 0;
+    std::thread emulator_thread_;
+    hydra::FrameScheduler scheduler_;
+    hydra::SyncMode sync_mode_ = hydra::SyncMode::Video;
+    bool gl_rendered_ = false;
+
+    // OpenGL cores render into the widget's context, so their frames are run on the GUI thread
+    // while the emulator thread waits for them to finish
+    std::mutex gl_frame_mutex_;
+    std::condition_variable gl_frame_cv_;
+    bool gl_frame_done_ = false;
 
     // Emulator
     std::shared_ptr<hydra::EmulatorWrapper> emulator_;
     std::unique_ptr<EmulatorInfo> info_;
-    std::string game_hash_;
     bool paused_ = false;
 
     // Video
-    std::vector<uint8_t> video_buffer_;
-    uint32_t video_width_ = 0;
-    uint32_t video_height_ = 0;
-    std::chrono::time_point<std::chrono::high_resolution_clock> last_emulation_second_time_;
+    hydra::FramePool frame_pool_;
+    std::atomic_bool frame_pending_ = false;
+    // Only touched by the emulator thread
+    bool frame_written_ = false;
+    // Whole-frame memcpys on the way from the core to the GPU, vs frames actually presented
+    std::atomic<uint64_t> frame_copies_ = 0;
+    std::atomic<uint64_t> frames_presented_ = 0;
 
     // Audio
+    // Written by the emulator thread and read by the audio device thread, neither may block
     // TODO: reduce size once done debugging
     hydra::ringbuffer<65536 * sizeof(float)> audio_buffer_;
     std::unique_ptr<ma_device, void (*)(ma_device*)> audio_device_;
     std::unique_ptr<ma_resampler, void (*)(ma_resampler*)> resampler_;
+    std::unique_ptr<hydra::SettingCallback> volume_watcher_;
+    // Bytes per frame of the negotiated device format, all channels included
     uint8_t audio_frame_size_ = 0;
+    std::atomic<uint64_t> audio_callback_worst_ns_ = 0;
+    // Bumped by the audio device after every read, the emulator thread waits on it when audio
+    // drives emulation
+    std::atomic<uint32_t> audio_reads_ = 0;
+    // Resampling happens on the emulator thread, in chunks through a preallocated buffer
+    static constexpr size_t resample_chunk_frames = 2048;
+    static constexpr double audio_max_rate_delta = 0.005;
+    std::vector<uint8_t> resample_buffer_;
+    // The resampler is given integer rates. The output rate is the device rate, halved until it
+    // fits the 16 bits miniaudio's linear resampler can handle without overflowing its timer.
+    // The input rate is the core rate at the same scale, divided by the current adjustment
+    uint32_t audio_rate_out_ = 1;
+    double audio_base_rate_in_ = 1.0;
+    uint32_t audio_rate_in_ = 0;
+    size_t audio_target_bytes_ = 1;
 
     // Input
     // Maps key -> pair<player, button>
     std::unordered_map<int, std::pair<int, hydra::ButtonType>> backwards_mappings_{};
-    // Holds the current state of the input
-    // vector[player][button]
-    std::vector<std::array<int32_t, (int)hydra::ButtonType::InputCount>> input_state_{};
+    // Holds the current state of the input, indexed by player * InputCount + button. Written by
+    // the key handlers on the GUI thread and read by the core on the emulator thread
+    std::unique_ptr<std::atomic<int32_t>[]> input_state_;
+    uint32_t input_players_ = 0;
     std::deque<std::string> recent_files_;
-    uint32_t mouse_state_ = hydra::TOUCH_RELEASED;
+    std::atomic<uint32_t> mouse_state_ = hydra::TOUCH_RELEASED;
 
     friend void emulator_signal_handler(int);
     friend void hungry_for_more(ma_device*, void*, const void*, ma_uint32);
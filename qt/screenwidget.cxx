@@ -1,7 +1,10 @@
 #include "screenwidget.hxx"
 #include <iostream>
+#include <fmt/format.h>
 #include <log.h>
+#include <profiler.hxx>
 #include <QFile>
+#include <QPainter>
 #include <QSurfaceFormat>
 
 ScreenWidget::ScreenWidget(QWidget* parent) : QOpenGLWidget(parent) {}
@@ -10,6 +13,8 @@ ScreenWidget::~ScreenWidget()
 {
     if (initialized_)
     {
+        makeCurrent();
+        pbo_ring_.Destroy();
         if (texture_ != 0)
             glDeleteTextures(1, &texture_);
         if (fbo_ != 0)
@@ -23,21 +28,10 @@ void ScreenWidget::Redraw(void* tdata)
     {
         if (tdata)
         {
-            // TODO: find a faster way to do this (set all alphas to max or ignore alpha - otherwise
-            // causes windows to be transparent on wayland)
-            for (int i = 3; i < current_width_ * current_height_ * 4; i += 4)
-            {
-                ((uint8_t*)tdata)[i] = 0xFF;
-            }
-            // Flip texture upside down when copying
-            glBindTexture(GL_TEXTURE_2D, texture_);
-            for (int i = 0; i < current_height_; i++)
-            {
-                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, current_height_ - i - 1, current_width_, 1,
-                                GL_RGBA, GL_UNSIGNED_BYTE,
-                                static_cast<const uint8_t*>(tdata) + current_width_ * 4 * i);
-            }
-            glBindTexture(GL_TEXTURE_2D, 0);
+            HYDRA_PROFILE_SCOPE("Texture upload");
+            makeCurrent();
+            if (pbo_ring_.Upload(texture_, tdata, current_width_, current_height_))
+                frames_copied_++;
         }
         update();
     }
@@ -57,10 +51,13 @@ void ScreenWidget::Resize(int width, int height)
                 glDeleteTextures(1, &texture_);
             glGenTextures(1, &texture_);
             glBindTexture(GL_TEXTURE_2D, texture_);
-            glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
+            // No alpha channel, whatever the core writes there is dropped on upload and the blit
+            // to the window fills in 1.0 (otherwise windows turn transparent on wayland)
+            glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGB8, width, height);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
             glBindTexture(GL_TEXTURE_2D, 0);
+            pbo_ring_.Create(width * height * 4);
             if (fbo_ != 0)
                 glDeleteFramebuffers(1, &fbo_);
             glGenFramebuffers(1, &fbo_);
@@ -115,7 +112,38 @@ void ScreenWidget::paintGL()
     {
         glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
         glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo_);
-        glBlitFramebuffer(0, 0, current_width_, current_height_, 0, 0, current_width_,
-                          current_height_, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        int dst_y0 = flip_ ? current_height_ : 0;
+        int dst_y1 = flip_ ? 0 : current_height_;
+        glBlitFramebuffer(0, 0, current_width_, current_height_, 0, dst_y0, current_width_, dst_y1,
+                          GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        if (overlay_)
+            paint_overlay();
     }
 }
+
+void ScreenWidget::paint_overlay()
+{
+    constexpr uint64_t window_ns = 1'000'000'000;
+    std::vector<hydra::ProfileStats> stats = hydra::Profiler::Summarize(window_ns);
+
+    std::string text;
+    for (const hydra::ProfileStats& stat : stats)
+    {
+        text += fmt::format("{}: {}/s, avg {:.3f}ms, max {:.3f}ms\n", stat.name, stat.count,
+                            stat.total_ns / 1e6 / stat.count, stat.max_ns / 1e6);
+    }
+    if (text.empty())
+        text = "No profiling data";
+
+    QPainter painter(this);
+    QFont font = painter.font();
+    font.setFamily("monospace");
+    font.setStyleHint(QFont::Monospace);
+    painter.setFont(font);
+    QRect bounds =
+        painter.boundingRect(rect().adjusted(4, 4, -4, -4), Qt::AlignLeft | Qt::AlignTop,
+                             QString::fromStdString(text));
+    painter.fillRect(bounds.adjusted(-2, -2, 2, 2), QColor(0, 0, 0, 160));
+    painter.setPen(Qt::white);
+    painter.drawText(bounds, Qt::AlignLeft | Qt::AlignTop, QString::fromStdString(text));
+}
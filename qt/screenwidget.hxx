@@ -9,6 +9,8 @@
 #include <QOpenGLWidget>
 #include <QResizeEvent>
 #include <QString>
+// After the Qt OpenGL headers, it uses their types
+#include <pboring.hxx>
 
 class ScreenWidget : public QOpenGLWidget, protected QOpenGLExtraFunctions
 {
@@ -48,12 +50,20 @@ private:
     void initializeGL() override;
     void resizeGL(int width, int height) override;
     void paintGL() override;
+    void paint_overlay();
     GLuint texture_ = 0;
     GLuint fbo_ = 0;
     bool initialized_ = false;
+    // Software rendered frames are stored top row first, they get flipped when blitting
+    bool flip_ = false;
+    // Draws the profiler statistics over the frame
+    bool overlay_ = false;
     int current_width_ = 0;
     int current_height_ = 0;
 
+    hydra::PboRing<QOpenGLExtraFunctions> pbo_ring_{*this};
+    uint64_t frames_copied_ = 0;
+
     std::function<void(QMouseEvent*)> mouse_move_callback_;
     std::function<void(QMouseEvent*)> mouse_click_callback_;
     std::function<void(QMouseEvent*)> mouse_release_callback_;
@@ -3,15 +3,19 @@
 #include <compatibility.hxx>
 #include <fmt/format.h>
 #include <QCheckBox>
+#include <QComboBox>
+#include <QFile>
+#include <QFutureWatcher>
 #include <QFileDialog>
 #include <QLabel>
 #include <QMessageBox>
 #include <QPushButton>
+#include <QSpinBox>
+#include <QtConcurrent/QtConcurrent>
 #include <QVBoxLayout>
 #include <settings.hxx>
 
-SettingsWindow::SettingsWindow(std::function<void(int)> volume_callback, QWidget* parent)
-    : QWidget(parent, Qt::Window), volume_callback_(volume_callback)
+SettingsWindow::SettingsWindow(QWidget* parent) : QWidget(parent, Qt::Window)
 {
     setFocusPolicy(Qt::StrongFocus);
     setWindowTitle("Settings");
@@ -40,54 +44,48 @@ SettingsWindow::SettingsWindow(std::function<void(int)> volume_callback, QWidget
             }
         }
 
+        // Icons that aren't cached yet are extracted on the thread pool, the items start out
+        // with a placeholder and are updated as the results come in
+        std::vector<QListWidgetItem*> core_items;
+        std::vector<std::string> core_names;
+        std::vector<std::string> core_paths;
+        QList<int> missing_icons;
         for (size_t i = 0; i < Settings::CoreInfo().size(); i++)
         {
-            std::filesystem::path path =
-                Settings::GetCachePath() / std::string(Settings::CoreInfo()[i].core_name + ".png");
+            const EmulatorInfo& core = Settings::CoreInfo()[i];
+            std::filesystem::path path = Settings::GetCoreIconPath(core.core_name);
+            QString icon = ":/images/core.png";
             if (std::filesystem::exists(path))
-            {
-                QListWidgetItem* item = new QListWidgetItem(
-                    QPixmap((path).string().c_str()), Settings::CoreInfo()[i].core_name.c_str());
-                tab_list_->addItem(item);
-            }
+                icon = path.string().c_str();
             else
-            {
-                auto wrapper = hydra::EmulatorFactory::Create(Settings::CoreInfo()[i].path);
-                QString cache_path = path.string().c_str();
-                if (wrapper->GetInfo(hydra::InfoType::IconData))
-                {
-                    uint32_t* icon_data = (uint32_t*)wrapper->GetInfo(hydra::InfoType::IconData);
-                    int width = std::atoi(wrapper->GetInfo(hydra::InfoType::IconWidth));
-                    int height = std::atoi(wrapper->GetInfo(hydra::InfoType::IconHeight));
-                    if (width <= 0 || height <= 0)
-                    {
-                        printf("Invalid icon size in core %s\n",
-                               Settings::CoreInfo()[i].core_name.c_str());
-                        continue;
-                    }
-                    QImage image(width, height, QImage::Format_RGBA8888);
-                    for (int y = 0; y < height; y++)
-                    {
-                        for (int x = 0; x < width; x++)
-                        {
-                            uint32_t color = icon_data[y * width + x];
-                            image.setPixelColor(x, y,
-                                                QColor(color >> 24, (color >> 16) & 0xFF,
-                                                       (color >> 8) & 0xFF, color & 0xFF));
-                        }
-                    }
-                    image.save(cache_path);
+                missing_icons.push_back(i);
+            QListWidgetItem* item = new QListWidgetItem(QPixmap(icon), core.core_name.c_str());
+            tab_list_->addItem(item);
+            core_items.push_back(item);
+            core_names.push_back(core.core_name);
+            core_paths.push_back(core.path);
+        }
 
-                    QListWidgetItem* item = new QListWidgetItem(
-                        QPixmap::fromImage(image), Settings::CoreInfo()[i].core_name.c_str());
-                    tab_list_->addItem(item);
-                }
-                else
-                {
-                    add_item(core, Settings::CoreInfo()[i].core_name.c_str(), "core.png");
-                    QFile::copy(QString(":/images/core.png"), cache_path);
-                }
-            }
+        if (!missing_icons.empty())
+        {
+            QFutureWatcher<int>* icon_watcher = new QFutureWatcher<int>(this);
+            connect(icon_watcher, &QFutureWatcher<int>::resultReadyAt, this,
+                    [icon_watcher, core_items, core_names](int result) {
+                        int index = icon_watcher->resultAt(result);
+                        std::filesystem::path path = Settings::GetCoreIconPath(core_names[index]);
+                        if (std::filesystem::exists(path))
+                            core_items[index]->setIcon(QPixmap(path.string().c_str()));
+                    });
+            icon_watcher->setFuture(
+                QtConcurrent::mapped(missing_icons, [core_paths, core_names](int index) {
+                    Settings::ProbeCore(core_paths[index]);
+                    // Cores without a usable icon get the placeholder cached, otherwise they
+                    // would be opened again every time this window is
+                    std::filesystem::path path = Settings::GetCoreIconPath(core_names[index]);
+                    if (!std::filesystem::exists(path))
+                        QFile::copy(":/images/core.png", path.string().c_str());
+                    return index;
+                }));
         }
 #undef add_item
         // clang-format off
@@ -174,8 +172,20 @@ void SettingsWindow::create_tabs()
                                                                         : Qt::Unchecked);
         general_layout->addWidget(use_cwd, 1, 0, 1, 2);
 
+        general_layout->addWidget(new QLabel("Synchronize to:"), 2, 0);
+        QComboBox* sync_combo = new QComboBox;
+        sync_combo->addItem("Video (core frame rate)", "video");
+        sync_combo->addItem("Audio device", "audio");
+        sync_combo->addItem("Nothing (free run)", "free");
+        int sync_index = sync_combo->findData(hydra::setting::sync_mode.Get().c_str());
+        sync_combo->setCurrentIndex(sync_index == -1 ? 0 : sync_index);
+        connect(sync_combo, &QComboBox::currentIndexChanged, this, [sync_combo](int index) {
+            hydra::setting::sync_mode.Set(sync_combo->itemData(index).toString().toStdString());
+        });
+        general_layout->addWidget(sync_combo, 2, 1, 1, 2);
+
         QSpacerItem* spacer = new QSpacerItem(0, 0, QSizePolicy::Minimum, QSizePolicy::Expanding);
-        general_layout->addItem(spacer, 2, 0);
+        general_layout->addItem(spacer, 3, 0);
 
         QPushButton* reset_settings = new QPushButton("Reset settings");
         connect(reset_settings, &QPushButton::clicked, this, [this]() {
@@ -184,14 +194,15 @@ void SettingsWindow::create_tabs()
                                                QMessageBox::Yes | QMessageBox::No);
             if (reply == QMessageBox::Yes)
             {
+                // Make sure the backup has everything that's still waiting to be written
+                Settings::Flush();
                 std::filesystem::copy(Settings::GetSavePath() / "settings.json",
                                       Settings::GetSavePath() / "settings.json.bak",
                                       std::filesystem::copy_options::overwrite_existing);
-                std::filesystem::remove(Settings::GetSavePath() / "settings.json");
-                Settings::Open(Settings::GetSavePath() / "settings.json");
+                Settings::Clear();
             }
         });
-        general_layout->addWidget(reset_settings, 3, 0, 1, 3);
+        general_layout->addWidget(reset_settings, 4, 0, 1, 3);
     }
     {
         QGridLayout* cores_layout = new QGridLayout;
@@ -264,21 +275,35 @@ void SettingsWindow::create_tabs()
         audio_layout->addWidget(new QLabel("Master volume:"), 0, 0);
         QSlider* audio_slider = new QSlider(Qt::Horizontal);
         audio_slider->setRange(0, 100);
-        std::string volume_str = Settings::Get("master_volume");
-        if (!volume_str.empty())
-        {
-            int volume = std::stoi(volume_str);
-            audio_slider->setValue(volume);
-        }
-        else
-        {
-            audio_slider->setValue(100);
-        }
-        connect(audio_slider, &QSlider::valueChanged, this, [this](int value) {
-            Settings::Set("master_volume", std::to_string(value));
-            volume_callback_(value);
-        });
+        audio_slider->setValue(hydra::setting::master_volume.Get());
+        // The main window watches this setting and applies it to the audio device
+        connect(audio_slider, &QSlider::valueChanged, this,
+                [](int value) { hydra::setting::master_volume.Set(value); });
         audio_layout->addWidget(audio_slider, 0, 1);
+
+        // These are picked up the next time a game is loaded
+        audio_layout->addWidget(new QLabel("Resampling quality:"), 1, 0);
+        QComboBox* quality_combo = new QComboBox;
+        quality_combo->addItem("Low", "low");
+        quality_combo->addItem("Medium", "medium");
+        quality_combo->addItem("High", "high");
+        int quality_index =
+            quality_combo->findData(hydra::setting::audio_resample_quality.Get().c_str());
+        quality_combo->setCurrentIndex(quality_index == -1 ? 1 : quality_index);
+        connect(quality_combo, &QComboBox::currentIndexChanged, this, [quality_combo](int index) {
+            hydra::setting::audio_resample_quality.Set(
+                quality_combo->itemData(index).toString().toStdString());
+        });
+        audio_layout->addWidget(quality_combo, 1, 1);
+
+        audio_layout->addWidget(new QLabel("Target latency:"), 2, 0);
+        QSpinBox* latency_spin = new QSpinBox;
+        latency_spin->setRange(8, 500);
+        latency_spin->setSuffix(" ms");
+        latency_spin->setValue(hydra::setting::audio_latency_ms.Get());
+        connect(latency_spin, &QSpinBox::valueChanged, this,
+                [](int value) { hydra::setting::audio_latency_ms.Set(value); });
+        audio_layout->addWidget(latency_spin, 2, 1);
     }
     for (size_t i = 0; i < Settings::CoreInfo().size(); i++)
     {
@@ -303,12 +328,10 @@ void SettingsWindow::create_tabs()
             core_layout->addWidget(new QLabel("Controller port " + QString::number(j) + ":"),
                                    current_row, 0);
             QCheckBox* active = new QCheckBox("Active");
-            std::string is_active =
-                Settings::Get(core_name + "_controller_" + std::to_string(j) + "_active");
-            active->setChecked(is_active == "true");
-            connect(active, &QCheckBox::stateChanged, this, [j, core_name](int state) {
-                Settings::Set(core_name + "_controller_" + std::to_string(j) + "_active",
-                              state == Qt::Checked ? "true" : "false");
+            std::shared_ptr<hydra::Setting<bool>> active_setting = core.controller_active[j - 1];
+            active->setChecked(active_setting->Get());
+            connect(active, &QCheckBox::stateChanged, this, [active_setting](int state) {
+                active_setting->Set(state == Qt::Checked);
             });
             core_layout->addWidget(make_input_combo(core_name.c_str(), j,
                                                     Settings::Get(core_name + "_mapping").c_str()),
@@ -14,7 +14,7 @@ class SettingsWindow : public QWidget
     Q_OBJECT
 
 public:
-    SettingsWindow(std::function<void(int)> volume_callback, QWidget* parent = nullptr);
+    SettingsWindow(QWidget* parent = nullptr);
     ~SettingsWindow() = default;
 
 private slots:
@@ -25,7 +25,6 @@ private:
     QTabWidget* tab_show_;
     QGroupBox *right_group_box_, *left_group_box_;
     InputPage* key_picker_;
-    std::function<void(int)> volume_callback_;
     std::vector<std::tuple<QComboBox*, int, QString>> listener_combos_;
     void keyPressEvent(QKeyEvent* event);
     void create_tabs();
@@ -9,8 +9,9 @@
 #include <QVBoxLayout>
 #include <settings.hxx>
 
+std::mutex TerminalWindow::logs_mutex_;
 std::unordered_map<std::string, std::string> TerminalWindow::logs_;
-bool TerminalWindow::changed_ = false;
+std::atomic_bool TerminalWindow::changed_ = false;
 
 TerminalWindow::TerminalWindow(QAction* action, QWidget* parent)
     : QWidget(parent, Qt::Window), menu_action_(action)
@@ -29,7 +30,10 @@ TerminalWindow::TerminalWindow(QAction* action, QWidget* parent)
     QAction* clear_action = toolbar->addAction("Clear");
     clear_action->setIcon(QIcon(":/images/trash.png"));
     connect(clear_action, &QAction::triggered, [this]() {
-        logs_[groups_combo_box_->currentText().toStdString()] = "";
+        {
+            std::lock_guard<std::mutex> lock(logs_mutex_);
+            logs_[groups_combo_box_->currentText().toStdString()].clear();
+        }
         on_group_changed(groups_combo_box_->currentText());
     });
     QAction* save_action = toolbar->addAction("Save");
@@ -74,9 +78,9 @@ TerminalWindow::TerminalWindow(QAction* action, QWidget* parent)
     layout->addWidget(edit_);
 
     QCheckBox* print_enabled = new QCheckBox("Print to native terminal");
-    print_enabled->setChecked(Settings::Get("print_to_native_terminal") == "true");
+    print_enabled->setChecked(hydra::setting::print_to_native_terminal.Get());
     connect(print_enabled, &QCheckBox::stateChanged, [](int state) {
-        Settings::Set("print_to_native_terminal", state == Qt::Checked ? "true" : "false");
+        hydra::setting::print_to_native_terminal.Set(state == Qt::Checked);
     });
     layout->addWidget(print_enabled);
 
@@ -90,27 +94,35 @@ TerminalWindow::TerminalWindow(QAction* action, QWidget* parent)
 
 void TerminalWindow::on_group_changed(const QString& group)
 {
-    edit_->setText(QString::fromStdString(logs_[group.toStdString()]));
+    QString text;
+    {
+        std::lock_guard<std::mutex> lock(logs_mutex_);
+        text = QString::fromStdString(logs_[group.toStdString()]);
+    }
+    edit_->setText(text);
 }
 
 void TerminalWindow::on_timeout()
 {
-    if (changed_)
+    if (changed_.exchange(false))
         on_group_changed(groups_combo_box_->currentText());
-    changed_ = false;
 }
 
 void TerminalWindow::log(const char* group, const char* message)
 {
-    logs_[group] += message;
-    logs_[group] += "\n";
+    {
+        std::lock_guard<std::mutex> lock(logs_mutex_);
+        std::string& log = logs_[group];
+        log += message;
+        log += "\n";
+    }
     changed_ = true;
 }
 
 void TerminalWindow::log_warn(const char* message)
 {
     log("Warn", message);
-    if (Settings::Get("print_to_native_terminal") == "true")
+    if (hydra::setting::print_to_native_terminal.Get())
     {
         std::cout << "[Warn] " << message << std::endl;
     }
@@ -119,7 +131,7 @@ void TerminalWindow::log_warn(const char* message)
 void TerminalWindow::log_info(const char* message)
 {
     log("Info", message);
-    if (Settings::Get("print_to_native_terminal") == "true")
+    if (hydra::setting::print_to_native_terminal.Get())
     {
         std::cout << "[Info] " << message << std::endl;
     }
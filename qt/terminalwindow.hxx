@@ -1,5 +1,7 @@
 #pragma once
 
+#include <atomic>
+#include <mutex>
 #include <QAction>
 #include <QComboBox>
 #include <QTextEdit>
@@ -40,6 +42,8 @@ private:
     void on_group_changed(const QString& group);
     void on_timeout();
 
+    // Cores log from the emulator thread, the window reads them on the GUI thread
+    static std::mutex logs_mutex_;
     static std::unordered_map<std::string, std::string> logs_;
-    static bool changed_;
+    static std::atomic_bool changed_;
 };
\ No newline at end of file
@@ -5,44 +5,231 @@
 #include <thread>
 #if defined(HYDRA_LINUX) || defined(HYDRA_MACOS)
 #include <arpa/inet.h>
+#include <csignal>
+#include <fcntl.h>
 #include <unistd.h>
+#if defined(HYDRA_LINUX)
+#include <sys/epoll.h>
+#else
+#include <poll.h>
+#endif
 #else
 #pragma message("TODO: include winsock2.h")
 #endif
 #include "glad.h"
+#include <algorithm>
 #include <array>
 #include <cstdint>
+#include <deque>
 #include <filesystem>
 #include <GLFW/glfw3.h>
 #include <hydra/core.h>
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include <netinet/tcp.h>
+#include <pixelconvert.hxx>
 #include <stb_image_write.h>
+#include <sys/uio.h>
 
 void* get_proc_address = nullptr;
 GLuint fbo = 0;
 void* context = nullptr;
-std::array<uint8_t, 400 * 480 * 4> buffer;
 std::unique_ptr<hydra::EmulatorWrapper> wrapper;
 
 namespace hydra
 {
 
-    void* malloc_packet(uint8_t type, void* body, uint32_t body_size, uint32_t* packet_size)
+    // Type, body size, body
+    constexpr size_t packet_header_size = sizeof(uint8_t) + sizeof(uint32_t);
+    // Nothing a client sends comes close, anything bigger is garbage
+    constexpr uint32_t max_client_packet_size = 64 * 1024;
+    // A client with this many replies waiting isn't read from until half of them went out
+    constexpr size_t max_queued_packets = 16;
+
+    constexpr uint32_t max_frame_width = 400;
+    constexpr uint32_t max_frame_height = 480;
+    constexpr size_t max_frame_size = max_frame_width * max_frame_height * 4;
+
+    std::array<uint8_t, packet_header_size> make_header(uint8_t type, uint32_t body_size)
     {
-        uint8_t* packet = (uint8_t*)malloc(sizeof(uint8_t) + sizeof(uint32_t) + body_size);
-        memset(packet, type, 1);
-        memcpy(packet + 1, &body_size, 4);
-        if (body_size != 0)
-            memcpy(packet + 1 + 4, body, body_size);
-        *packet_size = sizeof(uint8_t) + sizeof(uint32_t) + body_size;
-        return packet;
+        std::array<uint8_t, packet_header_size> header;
+        header[0] = type;
+        memcpy(header.data() + 1, &body_size, 4);
+        return header;
     }
 
-    void free_packet(void* packet)
+    // A read back frame, flipped and ready to be sent as is
+    struct frame_t
     {
-        free(packet);
-    }
+        std::vector<uint8_t> data = std::vector<uint8_t>(max_frame_size);
+        size_t size = max_frame_size;
+    };
+
+    // Frames are allocated up front and reused once no client is sending them anymore, so a
+    // video reply points at the frame instead of copying it. Every client holds at most the frame
+    // it's in the middle of sending, the ring only grows past its initial size when there are
+    // more of those than spare frames
+    class frame_ring_t
+    {
+    public:
+        frame_ring_t()
+        {
+            for (size_t i = 0; i < 4; i++)
+                frames_.push_back(std::make_shared<frame_t>());
+            // Black until the first readback finishes
+            latest_ = frames_.front();
+        }
+
+        std::shared_ptr<frame_t> acquire()
+        {
+            for (const std::shared_ptr<frame_t>& frame : frames_)
+            {
+                if (frame != latest_ && frame.use_count() == 1)
+                    return frame;
+            }
+            frames_.push_back(std::make_shared<frame_t>());
+            return frames_.back();
+        }
+
+        void publish(std::shared_ptr<frame_t> frame)
+        {
+            latest_ = std::move(frame);
+        }
+
+        std::shared_ptr<const frame_t> latest() const
+        {
+            return latest_;
+        }
+
+    private:
+        std::vector<std::shared_ptr<frame_t>> frames_;
+        std::shared_ptr<frame_t> latest_;
+    };
+
+    frame_ring_t frames;
+
+    // Reads frames back through a ring of pixel pack buffers. glReadPixels into a pack buffer
+    // returns right away, a fence marks when the copy is done and the buffer is only mapped after
+    // the fence signaled, so the core never waits on the GPU. Frames become available a frame or
+    // two after they were rendered. Every method makes GL calls, so it must only be used on the
+    // thread that owns the GL context
+    class readback_t
+    {
+    public:
+        void init()
+        {
+            for (pending_t& pending : pending_)
+            {
+                glGenBuffers(1, &pending.pbo);
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, pending.pbo);
+                glBufferData(GL_PIXEL_PACK_BUFFER, max_frame_size, nullptr, GL_STREAM_READ);
+            }
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+
+        void start(uint32_t width, uint32_t height)
+        {
+            if (width > max_frame_width || height > max_frame_height)
+            {
+                printf("Frame too big for readback: %ux%u\n", width, height);
+                return;
+            }
+
+            pending_t& pending = pending_[next_];
+            next_ = (next_ + 1) % pending_.size();
+            // Still not done after going around the whole ring, so the GPU may still be writing
+            // into this buffer. Only happens when the GPU is a whole ring behind, waiting for it
+            // is the only safe way to reuse the buffer
+            if (pending.fence)
+            {
+                GLenum status = glClientWaitSync(pending.fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                                 GL_TIMEOUT_IGNORED);
+                glDeleteSync(pending.fence);
+                pending.fence = nullptr;
+                if (status == GL_WAIT_FAILED)
+                {
+                    printf("glClientWaitSync() failed\n");
+                    glFinish();
+                }
+                else
+                {
+                    finish(pending);
+                }
+            }
+
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, pending.pbo);
+            glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            pending.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            pending.width = width;
+            pending.height = height;
+            // Otherwise the fence might sit in the command queue and polling it never succeeds
+            glFlush();
+        }
+
+        // Publishes every readback that finished, oldest first, without blocking
+        void collect()
+        {
+            for (size_t i = 0; i < pending_.size(); i++)
+            {
+                pending_t& pending = pending_[(next_ + i) % pending_.size()];
+                if (!pending.fence)
+                    continue;
+
+                GLenum status = glClientWaitSync(pending.fence, 0, 0);
+                // The ones after it were issued later, they aren't done either
+                if (status == GL_TIMEOUT_EXPIRED)
+                    break;
+
+                glDeleteSync(pending.fence);
+                pending.fence = nullptr;
+                if (status == GL_WAIT_FAILED)
+                {
+                    printf("glClientWaitSync() failed\n");
+                    continue;
+                }
+                finish(pending);
+            }
+        }
+
+    private:
+        struct pending_t
+        {
+            GLuint pbo = 0;
+            GLsync fence = nullptr;
+            uint32_t width = 0;
+            uint32_t height = 0;
+        };
+
+        void finish(const pending_t& pending)
+        {
+            size_t row_bytes = pending.width * 4;
+            size_t size = row_bytes * pending.height;
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, pending.pbo);
+            const uint8_t* mapped = static_cast<const uint8_t*>(
+                glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT));
+            if (mapped)
+            {
+                // GL rows start at the bottom, flipping while copying out of the mapping saves a
+                // separate pass over the frame
+                std::shared_ptr<frame_t> frame = frames.acquire();
+                hydra::pixel::flip_vertical(frame->data.data(), mapped, row_bytes, pending.height);
+                frame->size = size;
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+                frames.publish(std::move(frame));
+            }
+            else
+            {
+                printf("glMapBufferRange() failed\n");
+            }
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+
+        std::array<pending_t, 3> pending_;
+        size_t next_ = 0;
+    };
+
+    readback_t readback;
 
     void init_gl()
     {
@@ -69,6 +256,8 @@ namespace hydra
         glGenFramebuffers(1, &fbo);
         glBindFramebuffer(GL_FRAMEBUFFER, fbo);
         glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+
+        readback.init();
     }
 
     void* read_other_callback(hc_other_e other)
@@ -103,100 +292,187 @@ namespace hydra
 
     void video_callback(const uint8_t* data, uint32_t width, uint32_t height)
     {
-        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, buffer.data());
-
-        for (uint32_t y = 0; y < height / 2; y++)
-        {
-            for (uint32_t x = 0; x < width; x++)
-            {
-                std::swap(buffer[(y * width + x) * 4 + 0],
-                          buffer[((height - 1 - y) * width + x) * 4 + 0]);
-                std::swap(buffer[(y * width + x) * 4 + 1],
-                          buffer[((height - 1 - y) * width + x) * 4 + 1]);
-                std::swap(buffer[(y * width + x) * 4 + 2],
-                          buffer[((height - 1 - y) * width + x) * 4 + 2]);
-                std::swap(buffer[(y * width + x) * 4 + 3],
-                          buffer[((height - 1 - y) * width + x) * 4 + 3]);
-            }
-        }
+        readback.start(width, height);
+        readback.collect();
     }
 
     void audio_callback(const int16_t* data, uint32_t size) {}
 
-    struct socket_wrapper
+    // epoll on Linux, poll everywhere else. Level triggered, so a client that wasn't fully read
+    // or written is reported again on the next wait
+    class poller_t
     {
-        socket_wrapper(uint32_t socket) : socket_(socket) {}
+    public:
+        struct event_t
+        {
+            int fd;
+            bool readable;
+            bool writable;
+            bool error;
+        };
 
-        void read(void* data, uint32_t size)
+        poller_t()
         {
-            if (recv(socket_, data, size, 0) < 0)
-            {
-                printf("recv() failed\n");
-                close();
-            }
+#if defined(HYDRA_LINUX)
+            epoll_ = epoll_create1(EPOLL_CLOEXEC);
+            if (epoll_ < 0)
+                throw ErrorFactory::generate_exception(__func__, __LINE__,
+                                                       "epoll_create1() failed");
+#endif
         }
 
-        int send(void* data, uint32_t size)
+        ~poller_t()
         {
-            return ::send(socket_, data, size, 0);
+#if defined(HYDRA_LINUX)
+            close(epoll_);
+#endif
+        }
+
+        void add(int fd, bool read, bool write)
+        {
+#if defined(HYDRA_LINUX)
+            epoll_event event = make_event(fd, read, write);
+            if (epoll_ctl(epoll_, EPOLL_CTL_ADD, fd, &event) < 0)
+                printf("epoll_ctl(EPOLL_CTL_ADD) failed: %d\n", errno);
+#else
+            fds_.push_back({fd, make_events(read, write), 0});
+#endif
         }
 
-        uint32_t get()
+        void modify(int fd, bool read, bool write)
         {
-            return socket_;
+#if defined(HYDRA_LINUX)
+            epoll_event event = make_event(fd, read, write);
+            if (epoll_ctl(epoll_, EPOLL_CTL_MOD, fd, &event) < 0)
+                printf("epoll_ctl(EPOLL_CTL_MOD) failed: %d\n", errno);
+#else
+            for (pollfd& pfd : fds_)
+            {
+                if (pfd.fd == fd)
+                    pfd.events = make_events(read, write);
+            }
+#endif
         }
 
-        bool is_open()
+        void remove(int fd)
         {
-            return socket_ != 0;
+#if defined(HYDRA_LINUX)
+            epoll_ctl(epoll_, EPOLL_CTL_DEL, fd, nullptr);
+#else
+            fds_.erase(std::remove_if(fds_.begin(), fds_.end(),
+                                      [fd](const pollfd& pfd) { return pfd.fd == fd; }),
+                       fds_.end());
+#endif
         }
 
-        void close()
+        const std::vector<event_t>& wait()
         {
-            if (socket_)
+            events_.clear();
+#if defined(HYDRA_LINUX)
+            std::array<epoll_event, 64> events;
+            int count = epoll_wait(epoll_, events.data(), events.size(), -1);
+            for (int i = 0; i < count; i++)
             {
-                if (::close(socket_) < 0)
-                    printf("Warning: close() failed\n");
-                socket_ = 0;
+                events_.push_back({events[i].data.fd, (events[i].events & EPOLLIN) != 0,
+                                   (events[i].events & EPOLLOUT) != 0,
+                                   (events[i].events & (EPOLLERR | EPOLLHUP)) != 0});
             }
+#else
+            int count = ::poll(fds_.data(), fds_.size(), -1);
+            for (size_t i = 0; count > 0 && i < fds_.size(); i++)
+            {
+                if (fds_[i].revents == 0)
+                    continue;
+                events_.push_back({fds_[i].fd, (fds_[i].revents & POLLIN) != 0,
+                                   (fds_[i].revents & POLLOUT) != 0,
+                                   (fds_[i].revents & (POLLERR | POLLHUP | POLLNVAL)) != 0});
+            }
+#endif
+            if (count < 0 && errno != EINTR)
+                printf("Waiting for socket events failed: %d\n", errno);
+            return events_;
         }
 
     private:
-        uint32_t socket_ = 0;
-    };
-
-    struct packet_wrapper
-    {
-        packet_wrapper(socket_wrapper& socket, uint8_t type, void* body, uint32_t body_size)
-            : socket_(socket)
+#if defined(HYDRA_LINUX)
+        static epoll_event make_event(int fd, bool read, bool write)
         {
-            packet_ = malloc_packet(type, body, body_size, &packet_size_);
+            epoll_event event = {};
+            event.events = (read ? EPOLLIN : 0) | (write ? EPOLLOUT : 0);
+            event.data.fd = fd;
+            return event;
         }
 
-        ~packet_wrapper()
+        int epoll_ = -1;
+#else
+        static short make_events(bool read, bool write)
         {
-            if (packet_)
-                free_packet(packet_);
+            return (read ? POLLIN : 0) | (write ? POLLOUT : 0);
         }
 
-        void send()
+        std::vector<pollfd> fds_;
+#endif
+        std::vector<event_t> events_;
+    };
+
+    struct outgoing_t
+    {
+        std::array<uint8_t, packet_header_size> header;
+        // Keeps the body alive, for video replies it's a frame shared with every other client
+        // sending it. A video reply is bound to the newest frame only once it's its turn to be
+        // sent, so a client that fell behind skips the frames it missed instead of getting them
+        // late
+        std::shared_ptr<const void> body_owner;
+        const uint8_t* body = nullptr;
+        size_t body_size = 0;
+        size_t sent = 0;
+        bool video = false;
+    };
+
+    struct client_t
+    {
+        int fd;
+        sockaddr_in addr;
+
+        // Incoming packet, first the header and then the body it announced
+        std::array<uint8_t, packet_header_size> header;
+        size_t header_read = 0;
+        std::vector<uint8_t> body;
+        size_t body_read = 0;
+
+        std::deque<outgoing_t> outgoing;
+        // Off while too many replies are waiting, the requests then stay in the socket buffer
+        bool reading = true;
+        // Closed once everything queued went out
+        bool closing = false;
+
+        uint8_t type() const
         {
-            if (socket_.send(packet_, packet_size_) < 0)
-            {
-                printf("send() failed\n");
-                socket_.close();
-            }
+            return header[0];
         }
 
-    private:
-        socket_wrapper& socket_;
-        void* packet_ = nullptr;
-        uint32_t packet_size_ = 0;
+        // Copies the body into a packet struct, a short body leaves the rest zeroed
+        template <class T>
+        T body_as() const
+        {
+            T value;
+            memset(&value, 0, sizeof(value));
+            memcpy(&value, body.data(), std::min(sizeof(value), body.size()));
+            return value;
+        }
     };
 
+    bool set_non_blocking(int fd)
+    {
+        int flags = fcntl(fd, F_GETFL, 0);
+        return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) >= 0;
+    }
+
     server_t::server_t()
     {
+        // Writes to a client that went away fail with EPIPE instead of killing the server
+        signal(SIGPIPE, SIG_IGN);
+
         socket_ = socket(AF_INET, SOCK_STREAM, 0);
         sockaddr_in addr;
         addr.sin_family = AF_INET;
@@ -206,15 +482,8 @@ namespace hydra
         if (setsockopt(socket_, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(int)) < 0)
             throw ErrorFactory::generate_exception(__func__, __LINE__,
                                                    "setsockopt(SO_REUSEADDR) failed");
-        if (setsockopt(socket_, SOL_SOCKET, SO_KEEPALIVE, (void*)&enable, sizeof(int) < 0))
-            throw ErrorFactory::generate_exception(__func__, __LINE__,
-                                                   "setsockopt(SO_KEEPALIVE) failed");
-        if (setsockopt(socket_, IPPROTO_TCP, TCP_NODELAY, (void*)&enable, sizeof(int) < 0))
-            throw ErrorFactory::generate_exception(__func__, __LINE__,
-                                                   "setsockopt(TCP_NODELAY) failed");
-        if (setsockopt(socket_, IPPROTO_TCP, TCP_QUICKACK, (void*)&enable, sizeof(int) < 0))
-            throw ErrorFactory::generate_exception(__func__, __LINE__,
-                                                   "setsockopt(TCP_QUICKACK) failed");
+        if (!set_non_blocking(socket_))
+            throw ErrorFactory::generate_exception(__func__, __LINE__, "fcntl(O_NONBLOCK) failed");
         if (auto res = bind(socket_, (sockaddr*)&addr, sizeof(addr)); res < 0)
         {
             printf("bind() failed: %d\n", errno);
@@ -229,6 +498,9 @@ namespace hydra
         printf("Listening on address %s:%d...\n", inet_ntoa(server_addr.sin_addr),
                ntohs(server_addr.sin_port));
 
+        poller_ = std::make_unique<poller_t>();
+        poller_->add(socket_, true, false);
+
         init_gl();
 
         core_ = new core_wrapper_t(std::filesystem::path("/home/offtkp/cores/libAlber.so"));
@@ -246,110 +518,319 @@ namespace hydra
 
     server_t::~server_t()
     {
+        while (!clients_.empty())
+            close_client(clients_.begin()->first);
         if (close(socket_) < 0)
             printf("Warning: close() failed\n");
     }
 
-    void client_loop(socket_wrapper client_socket, sockaddr_in client_addr)
+    void server_t::accept_loop()
+    {
+        while (true)
+        {
+            for (const poller_t::event_t& event : poller_->wait())
+            {
+                if (event.fd == (int)socket_)
+                {
+                    accept_clients();
+                    continue;
+                }
+
+                // Closed by an earlier event of this batch
+                auto it = clients_.find(event.fd);
+                if (it == clients_.end())
+                    continue;
+
+                client_t& client = *it->second;
+                if (event.error)
+                {
+                    close_client(client.fd);
+                    continue;
+                }
+                if (event.readable)
+                    read_client(client);
+                if (clients_.count(event.fd) && event.writable)
+                    write_client(client);
+            }
+        }
+    }
+
+    void server_t::accept_clients()
     {
-        printf("Accepted connection from %s:%d\n", inet_ntoa(client_addr.sin_addr),
-               ntohs(client_addr.sin_port));
-        while (client_socket.is_open())
+        while (true)
         {
-            uint8_t packet_type;
-            client_socket.read(&packet_type, 1);
-            printf("Received packet type: %d\n", packet_type);
+            sockaddr_in client_addr;
+            socklen_t client_addr_len = sizeof(client_addr);
+            int client_socket = accept(socket_, (sockaddr*)&client_addr, &client_addr_len);
+            if (client_socket < 0)
+            {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                    printf("accept() failed: %d\n", errno);
+                return;
+            }
+
+            const int enable = 1;
+            if (!set_non_blocking(client_socket))
+            {
+                printf("fcntl(O_NONBLOCK) failed\n");
+                close(client_socket);
+                continue;
+            }
+            setsockopt(client_socket, SOL_SOCKET, SO_KEEPALIVE, &enable, sizeof(int));
+            setsockopt(client_socket, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(int));
+#if defined(HYDRA_LINUX)
+            setsockopt(client_socket, IPPROTO_TCP, TCP_QUICKACK, &enable, sizeof(int));
+#endif
 
-            uint32_t packet_size;
-            client_socket.read(&packet_size, 4);
-            printf("Received packet size: %d\n", packet_size);
+            auto client = std::make_unique<client_t>();
+            client->fd = client_socket;
+            client->addr = client_addr;
+            poller_->add(client_socket, true, false);
+            clients_[client_socket] = std::move(client);
+            printf("Accepted connection from %s:%d (%zu clients)\n",
+                   inet_ntoa(client_addr.sin_addr), ntohs(client_addr.sin_port),
+                   clients_.size());
+        }
+    }
+
+    void server_t::read_client(client_t& client)
+    {
+        int fd = client.fd;
+        while (client.reading && !client.closing)
+        {
+            bool in_header = client.header_read < client.header.size();
+            uint8_t* destination = in_header ? client.header.data() + client.header_read
+                                             : client.body.data() + client.body_read;
+            size_t wanted = in_header ? client.header.size() - client.header_read
+                                      : client.body.size() - client.body_read;
 
-            switch (packet_type)
+            if (wanted != 0)
             {
-                case HC_PACKET_TYPE_version:
+                ssize_t received = recv(fd, destination, wanted, 0);
+                if (received == 0)
                 {
-                    hc_client_version_t version;
-                    client_socket.read(&version, sizeof(version));
-                    printf("Client version: %04x\n", version.version);
-                    hc_server_version_ack_t version_ack;
-                    version_ack.response = (version.version == HC_PROTOCOL_VERSION)
-                                               ? HC_RESPONSE_OK
-                                               : HC_RESPONSE_ERROR;
-                    packet_wrapper wrapper(client_socket, HC_PACKET_TYPE_version_ack, &version_ack,
-                                           sizeof(version_ack));
-                    wrapper.send();
-                    if (version_ack.response == HC_RESPONSE_ERROR)
-                    {
-                        printf("Client version does not match server version: %04x!\n",
-                               HC_PROTOCOL_VERSION);
-                        client_socket.close();
-                    }
-                    else
-                    {
-                        printf("Client version matches server version!\n");
-                    }
-                    break;
+                    close_client(fd);
+                    return;
                 }
-                case HC_PACKET_TYPE_video:
+                else if (received < 0)
                 {
-                    hc_client_video_t video;
-                    client_socket.read(&video, sizeof(video));
-                    packet_wrapper wrapper(client_socket, HC_PACKET_TYPE_video_ack, buffer.data(),
-                                           buffer.size());
-                    wrapper.send();
-                    break;
+                    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                        return;
+                    printf("recv() failed: %d\n", errno);
+                    close_client(fd);
+                    return;
                 }
-                case HC_PACKET_TYPE_step:
+
+                if (in_header)
                 {
-                    hc_client_step_t step;
-                    client_socket.read(&step, sizeof(step));
-                    for (uint16_t i = 0; i < step.frames; i++)
+                    client.header_read += received;
+                    if (client.header_read < client.header.size())
+                        continue;
+
+                    uint32_t body_size;
+                    memcpy(&body_size, client.header.data() + 1, 4);
+                    if (body_size > max_client_packet_size)
                     {
-                        core_->hc_run_frame_p(core_->core_handle);
+                        printf("Packet of %u bytes from client, closing\n", body_size);
+                        close_client(fd);
+                        return;
                     }
-                    hc_server_step_ack_t step_ack;
-                    step_ack.response = HC_RESPONSE_OK;
-                    packet_wrapper wrapper(client_socket, HC_PACKET_TYPE_step_ack, &step_ack,
-                                           sizeof(step_ack));
-                    wrapper.send();
-                    break;
+                    client.body.resize(body_size);
+                    client.body_read = 0;
+                    if (body_size != 0)
+                        continue;
                 }
-                case HC_PACKET_TYPE_discord_plays_special_input:
+                else
                 {
-                    hc_client_discord_plays_special_input_t discord_plays_special_input;
-                    client_socket.read(&discord_plays_special_input,
-                                       sizeof(discord_plays_special_input));
-                    // AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA
-                    packet_wrapper wrapper(client_socket,
-                                           HC_PACKET_TYPE_discord_plays_special_input_ack,
-                                           buffer.data(), buffer.size());
-                    break;
+                    client.body_read += received;
+                    if (client.body_read < client.body.size())
+                        continue;
                 }
-                default:
-                    printf("Unknown packet type: %d\n", packet_type);
+            }
+
+            handle_packet(client);
+            if (!clients_.count(fd))
+                return;
+            client.header_read = 0;
+            client.body_read = 0;
+            client.body.clear();
+
+            if (client.outgoing.size() >= max_queued_packets)
+            {
+                client.reading = false;
+                update_interest(client);
+            }
+        }
+    }
+
+    void server_t::write_client(client_t& client)
+    {
+        int fd = client.fd;
+        while (!client.outgoing.empty())
+        {
+            outgoing_t& front = client.outgoing.front();
+            if (front.video && !front.body_owner)
+            {
+                // Makes GL calls, see server_t about which thread this runs on
+                readback.collect();
+                std::shared_ptr<const frame_t> frame = frames.latest();
+                front.header = make_header(HC_PACKET_TYPE_video_ack, frame->size);
+                front.body = frame->data.data();
+                front.body_size = frame->size;
+                front.body_owner = std::move(frame);
+            }
+
+            // Header and body go out in one call, straight from where they are
+            iovec iov[2];
+            int iov_count = 0;
+            size_t header_left =
+                front.sent < front.header.size() ? front.header.size() - front.sent : 0;
+            size_t body_sent = front.sent - (front.header.size() - header_left);
+            if (header_left != 0)
+                iov[iov_count++] = {front.header.data() + front.sent, header_left};
+            if (body_sent < front.body_size)
+            {
+                iov[iov_count++] = {const_cast<uint8_t*>(front.body) + body_sent,
+                                    front.body_size - body_sent};
+            }
+
+            ssize_t sent = writev(fd, iov, iov_count);
+            if (sent < 0)
+            {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
                     break;
+                printf("writev() failed: %d\n", errno);
+                close_client(fd);
+                return;
             }
+
+            front.sent += sent;
+            if (front.sent == front.header.size() + front.body_size)
+                client.outgoing.pop_front();
         }
-        printf("Connection closed from %s:%d\n", inet_ntoa(client_addr.sin_addr),
-               ntohs(client_addr.sin_port));
+
+        if (client.closing && client.outgoing.empty())
+        {
+            close_client(fd);
+            return;
+        }
+
+        if (!client.reading && client.outgoing.size() <= max_queued_packets / 2)
+        {
+            // Requests that piled up in the socket buffer are reported on the next wait
+            client.reading = true;
+        }
+        update_interest(client);
     }
 
-    void server_t::accept_loop()
+    void server_t::queue_packet(client_t& client, uint8_t type, const void* body,
+                                uint32_t body_size)
     {
-        while (true)
+        auto data = std::make_shared<std::vector<uint8_t>>(
+            static_cast<const uint8_t*>(body), static_cast<const uint8_t*>(body) + body_size);
+        outgoing_t outgoing;
+        outgoing.header = make_header(type, body_size);
+        outgoing.body = data->data();
+        outgoing.body_size = data->size();
+        outgoing.body_owner = std::move(data);
+        client.outgoing.push_back(std::move(outgoing));
+        start_sending(client);
+    }
+
+    void server_t::queue_video(client_t& client)
+    {
+        outgoing_t outgoing;
+        outgoing.header = make_header(HC_PACKET_TYPE_video_ack, 0);
+        outgoing.video = true;
+        client.outgoing.push_back(std::move(outgoing));
+        start_sending(client);
+    }
+
+    void server_t::start_sending(client_t& client)
+    {
+        // Most replies go out right away, without waiting for the next round of events
+        if (client.outgoing.size() == 1)
+            write_client(client);
+        else
+            update_interest(client);
+    }
+
+    void server_t::update_interest(client_t& client)
+    {
+        poller_->modify(client.fd, client.reading && !client.closing, !client.outgoing.empty());
+    }
+
+    void server_t::close_client(int fd)
+    {
+        auto it = clients_.find(fd);
+        if (it == clients_.end())
+            return;
+
+        client_t& client = *it->second;
+        poller_->remove(fd);
+        if (::close(fd) < 0)
+            printf("Warning: close() failed\n");
+        printf("Connection closed from %s:%d (%zu clients)\n", inet_ntoa(client.addr.sin_addr),
+               ntohs(client.addr.sin_port), clients_.size() - 1);
+        clients_.erase(it);
+    }
+
+    void server_t::handle_packet(client_t& client)
+    {
+        switch (client.type())
         {
-            sockaddr_in client_addr;
-            socklen_t client_addr_len = sizeof(client_addr);
-            int client_socket = accept(socket_, (sockaddr*)&client_addr, &client_addr_len);
-            if (client_socket < 0)
+            case HC_PACKET_TYPE_version:
             {
-                printf(__func__, __LINE__, "accept() failed");
+                hc_client_version_t version = client.body_as<hc_client_version_t>();
+                printf("Client version: %04x\n", version.version);
+                hc_server_version_ack_t version_ack;
+                version_ack.response = (version.version == HC_PROTOCOL_VERSION)
+                                           ? HC_RESPONSE_OK
+                                           : HC_RESPONSE_ERROR;
+                if (version_ack.response == HC_RESPONSE_ERROR)
+                {
+                    printf("Client version does not match server version: %04x!\n",
+                           HC_PROTOCOL_VERSION);
+                    client.closing = true;
+                }
+                else
+                {
+                    printf("Client version matches server version!\n");
+                }
+                queue_packet(client, HC_PACKET_TYPE_version_ack, &version_ack,
+                             sizeof(version_ack));
+                break;
             }
-            else
+            case HC_PACKET_TYPE_video:
             {
-                socket_wrapper wrapper(client_socket);
-                client_loop(wrapper, client_addr);
+                queue_video(client);
+                break;
             }
+            case HC_PACKET_TYPE_step:
+            {
+                // Any client can step the shared core, the others see the result in their next
+                // video reply
+                hc_client_step_t step = client.body_as<hc_client_step_t>();
+                for (uint16_t i = 0; i < step.frames; i++)
+                {
+                    core_->hc_run_frame_p(core_->core_handle);
+                }
+                hc_server_step_ack_t step_ack;
+                step_ack.response = HC_RESPONSE_OK;
+                queue_packet(client, HC_PACKET_TYPE_step_ack, &step_ack, sizeof(step_ack));
+                break;
+            }
+            case HC_PACKET_TYPE_discord_plays_special_input:
+            {
+                hc_client_discord_plays_special_input_t discord_plays_special_input =
+                    client.body_as<hc_client_discord_plays_special_input_t>();
+                (void)discord_plays_special_input;
+                // AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA
+                break;
+            }
+            default:
+                printf("Unknown packet type: %d\n", client.type());
+                break;
         }
     }
 
@@ -8,9 +8,19 @@
 #pragma message("TODO: include winsock2.h")
 #endif
 #include "corewrapper.hxx"
+#include <memory>
+#include <unordered_map>
 
 namespace hydra
 {
+    struct client_t;
+    class poller_t;
+
+    // Serves any number of clients from one thread. Sockets are non-blocking and every client
+    // has its own read and write state, so a slow or stalled client only ever delays itself.
+    // All clients share the one emulator instance. Replying to a video request collects finished
+    // GL readbacks, so the constructor, which creates the GL context, and accept_loop must run on
+    // the same thread
     class server_t final
     {
     public:
@@ -20,6 +30,18 @@ namespace hydra
         void accept_loop();
 
     private:
+        void accept_clients();
+        void read_client(client_t& client);
+        void write_client(client_t& client);
+        void handle_packet(client_t& client);
+        void queue_packet(client_t& client, uint8_t type, const void* body, uint32_t body_size);
+        void queue_video(client_t& client);
+        void start_sending(client_t& client);
+        void update_interest(client_t& client);
+        void close_client(int fd);
+
         uint32_t socket_;
+        std::unique_ptr<poller_t> poller_;
+        std::unordered_map<int, std::unique_ptr<client_t>> clients_;
     };
 } // namespace hydra
\ No newline at end of file
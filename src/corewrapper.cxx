@@ -1,8 +1,13 @@
 #include "hydra/core.hxx"
-#define OPENSSL_API_COMPAT 10101
+#include <cheatdb.hxx>
 #include <corewrapper.hxx>
-#include <openssl/md5.h>
+#include <fmt/format.h>
+#include <future>
+#include <log.h>
+#include <profiler.hxx>
+#include <romhash.hxx>
 #include <settings.hxx>
+#include <unordered_set>
 
 namespace hydra
 {
@@ -14,32 +19,23 @@ namespace hydra
 
     EmulatorWrapper::~EmulatorWrapper()
     {
+        // Writes pending cheat changes while everything is still alive
+        cheat_writer_.reset();
         destroy_function(shell);
         dynlib_close(handle);
     }
 
     bool EmulatorWrapper::LoadGame(const std::filesystem::path& path)
     {
-        unsigned char result[MD5_DIGEST_LENGTH];
-        std::ifstream file(path, std::ifstream::binary);
-        MD5_CTX md5Context;
-        MD5_Init(&md5Context);
-        char buf[1024 * 16];
-        while (file.good())
-        {
-            file.read(buf, sizeof(buf));
-            MD5_Update(&md5Context, buf, file.gcount());
-        }
-        MD5_Final(result, &md5Context);
-        std::stringstream md5stream;
-        md5stream << std::hex << std::setfill('0');
-        for (const auto& byte : result)
-        {
-            md5stream << std::setw(2) << (int)byte;
-        }
-        game_hash_ = md5stream.str();
+        // The rom is hashed while the core loads it, the hash is only needed for the cheats
+        std::string algorithm = hydra::setting::rom_hash.Get();
+        std::future<std::string> hash = std::async(std::launch::async, [path, algorithm]() {
+            HYDRA_PROFILE_SCOPE("Hash rom");
+            return hydra::hash_rom(path, algorithm);
+        });
 
         bool ret = shell->asIBase()->loadFile("rom", path.string().c_str());
+        game_hash_ = hash.get();
 
         if (shell->hasInterface(hydra::InterfaceType::ICheat))
         {
@@ -54,6 +50,22 @@ namespace hydra
         return get_info_function(type);
     }
 
+    const std::vector<uint8_t>& EmulatorWrapper::GetIcon()
+    {
+        // Loading a game doesn't need the icon, so it's only encoded when someone asks for it
+        if (icon_.empty())
+        {
+            std::string core_name = GetInfo(hydra::InfoType::CoreName);
+            if (Settings::CacheCoreIcon(core_name, get_info_function))
+            {
+                std::ifstream file(Settings::GetCoreIconPath(core_name), std::ios::binary);
+                icon_.assign(std::istreambuf_iterator<char>(file),
+                             std::istreambuf_iterator<char>());
+            }
+        }
+        return icon_;
+    }
+
     void EmulatorWrapper::init_cheats()
     {
         if (!std::filesystem::create_directories(Settings::GetSavePath() / "cheats"))
@@ -71,58 +83,114 @@ namespace hydra
         printf("cheat path: %s\n", cheat_path.c_str());
         if (std::filesystem::exists(cheat_path))
         {
-            hydra::ICheat* cheat_interface = shell->asICheat();
             std::ifstream cheat_file(cheat_path);
-            nlohmann::json cheat_json;
-            cheat_file >> cheat_json;
-            for (auto& cheat : cheat_json)
+            nlohmann::json cheat_json = nlohmann::json::parse(cheat_file, nullptr, false);
+            if (!cheat_json.is_array())
             {
-                CheatMetadata cheat_metadata;
-                std::vector<uint8_t> bytes = hydra::hex_to_bytes(cheat_metadata.code);
-                cheat_metadata.handle = cheat_interface->addCheat(bytes.data(), bytes.size());
-
-                if (cheat_metadata.handle != hydra::BAD_CHEAT)
+                log_warn(fmt::format("Failed to parse {}", cheat_path.string()).c_str());
+            }
+            else
+            {
+                std::vector<CheatMetadata> cheats;
+                cheats.reserve(cheat_json.size());
+                for (auto& cheat : cheat_json)
                 {
-                    cheat_metadata.enabled = cheat["enabled"] == "true";
-                    cheat_metadata.name = cheat["name"];
-                    cheat_metadata.code = cheat["code"];
-
-                    if (cheat_metadata.enabled)
-                    {
-                        cheat_interface->enableCheat(cheat_metadata.handle);
-                    }
-                    else
-                    {
-                        cheat_interface->disableCheat(cheat_metadata.handle);
-                    }
-                    cheats_.push_back(cheat_metadata);
+                    if (!cheat.is_object())
+                        continue;
+                    CheatMetadata cheat_metadata;
+                    cheat_metadata.enabled = cheat.value("enabled", "false") == "true";
+                    cheat_metadata.name = cheat.value("name", "");
+                    cheat_metadata.code = cheat.value("code", "");
+                    cheats.push_back(std::move(cheat_metadata));
                 }
+                AddCheats(cheats);
             }
         }
+
+        // Database entries are merged the first time the game is loaded after an import, the
+        // save afterwards makes the cheat file newer, so cheats removed since then stay removed
+        size_t merged = 0;
+        std::error_code error;
+        auto database_time =
+            std::filesystem::last_write_time(CheatDatabase::GetGamePath(game_hash_), error);
+        if (!error)
+        {
+            auto cheats_time = std::filesystem::last_write_time(cheat_path, error);
+            if (error || database_time > cheats_time)
+                merged = MergeCheatDatabase();
+        }
+
+        // Created after loading, so only the merge counts as a change
+        cheat_writer_ = std::make_unique<hydra::WriteBehind>([this]() { save_cheats(); });
+        if (merged != 0)
+            mark_cheats_dirty();
     }
 
+    // Runs on the write-behind thread
     void EmulatorWrapper::save_cheats()
     {
-        nlohmann::json cheat_json;
-        for (const hydra::CheatMetadata& cheat : cheats_)
+        nlohmann::json cheat_json = nlohmann::json::array();
         {
-            cheat_json.push_back({{"enabled", cheat.enabled ? "true" : "false"},
-                                  {"name", cheat.name},
-                                  {"code", cheat.code}});
+            std::unique_lock<std::mutex> lock(cheats_mutex_);
+            for (const hydra::CheatMetadata& cheat : cheats_)
+            {
+                cheat_json.push_back({{"enabled", cheat.enabled ? "true" : "false"},
+                                      {"name", cheat.name},
+                                      {"code", cheat.code}});
+            }
         }
-        std::ofstream cheat_file(Settings::GetSavePath() / "cheats" / (game_hash_ + ".json"));
-        cheat_file << cheat_json.dump(4);
+        hydra::write_file_atomic(Settings::GetSavePath() / "cheats" / (game_hash_ + ".json"),
+                                 cheat_json.dump(4));
     }
 
-    const CheatMetadata& EmulatorWrapper::GetCheat(uint32_t handle)
+    void EmulatorWrapper::mark_cheats_dirty()
     {
-        for (auto& cheat : cheats_)
+        if (cheat_writer_)
+            cheat_writer_->MarkDirty();
+    }
+
+    // Adds the code to the core only, the core lock must be held
+    uint32_t EmulatorWrapper::add_cheat(const std::vector<uint8_t>& bytes, bool enabled)
+    {
+        if (bytes.empty())
+            return hydra::BAD_CHEAT;
+
+        ICheat* cheat_interface = shell->asICheat();
+        uint32_t handle = cheat_interface->addCheat(bytes.data(), bytes.size());
+        if (handle != hydra::BAD_CHEAT)
         {
-            if (cheat.handle == handle)
-            {
-                return cheat;
-            }
+            if (enabled)
+                cheat_interface->enableCheat(handle);
+            else
+                cheat_interface->disableCheat(handle);
+        }
+        return handle;
+    }
+
+    CheatMetadata* EmulatorWrapper::find_cheat(uint32_t handle)
+    {
+        auto it = cheat_index_.find(handle);
+        if (it == cheat_index_.end())
+            return nullptr;
+        return &cheats_[it->second];
+    }
+
+    // Keeps the order, so the positions after index move down by one. The lock must be held
+    void EmulatorWrapper::erase_cheat(size_t index)
+    {
+        cheat_index_.erase(cheats_[index].handle);
+        cheats_.erase(cheats_.begin() + index);
+        for (size_t i = index; i < cheats_.size(); i++)
+        {
+            cheat_index_[cheats_[i].handle] = i;
         }
+    }
+
+    const CheatMetadata& EmulatorWrapper::GetCheat(uint32_t handle)
+    {
+        CheatMetadata* cheat = find_cheat(handle);
+        if (cheat)
+            return *cheat;
         static CheatMetadata empty;
         return empty;
     }
@@ -132,89 +200,139 @@ namespace hydra
         return cheats_;
     }
 
-    uint32_t EmulatorWrapper::EditCheat(const CheatMetadata& cheat, uint32_t old_handle)
+    std::vector<uint32_t> EmulatorWrapper::AddCheats(const std::vector<CheatMetadata>& cheats)
     {
-        hydra::ScopeGuard guard([this]() { save_cheats(); });
+        // Decoded before taking the locks. Codes are a few short hex strings, so this is cheaper
+        // than starting threads for it
+        std::vector<std::vector<uint8_t>> codes;
+        codes.reserve(cheats.size());
+        for (const CheatMetadata& cheat : cheats)
+            codes.push_back(hydra::hex_to_bytes(cheat.code));
 
-        if (old_handle == hydra::BAD_CHEAT)
+        std::vector<uint32_t> handles;
+        handles.reserve(cheats.size());
         {
-            ICheat* cheat_interface = shell->asICheat();
-            std::vector<uint8_t> bytes = hydra::hex_to_bytes(cheat.code);
-            uint32_t handle = cheat_interface->addCheat(bytes.data(), bytes.size());
-            if (handle != hydra::BAD_CHEAT)
+            std::unique_lock<std::mutex> core_lock = LockCore();
+            std::unique_lock<std::mutex> lock(cheats_mutex_);
+            cheats_.reserve(cheats_.size() + cheats.size());
+            cheat_index_.reserve(cheats_.size() + cheats.size());
+            for (size_t i = 0; i < cheats.size(); i++)
             {
+                const CheatMetadata& cheat = cheats[i];
+                uint32_t handle = add_cheat(codes[i], cheat.enabled);
+                handles.push_back(handle);
+                if (handle == hydra::BAD_CHEAT)
+                    continue;
+                cheat_index_[handle] = cheats_.size();
                 cheats_.push_back(cheat);
                 cheats_.back().handle = handle;
-                cheat_interface->disableCheat(handle);
-                return handle;
             }
-            return hydra::BAD_CHEAT;
         }
-        else
+        mark_cheats_dirty();
+        return handles;
+    }
+
+    size_t EmulatorWrapper::MergeCheatDatabase()
+    {
+        std::vector<CheatMetadata> cheats = CheatDatabase::Load(game_hash_);
+        if (cheats.empty())
+            return 0;
+
+        std::unordered_set<std::string> codes;
         {
-            for (auto& cheat_metadata : cheats_)
+            std::unique_lock<std::mutex> lock(cheats_mutex_);
+            for (const CheatMetadata& cheat : cheats_)
+                codes.insert(cheat.code);
+        }
+        std::erase_if(cheats, [&codes](const CheatMetadata& cheat) {
+            return !codes.insert(cheat.code).second;
+        });
+
+        std::vector<uint32_t> handles = AddCheats(cheats);
+        return std::count_if(handles.begin(), handles.end(),
+                             [](uint32_t handle) { return handle != hydra::BAD_CHEAT; });
+    }
+
+    uint32_t EmulatorWrapper::EditCheat(const CheatMetadata& cheat, uint32_t old_handle)
+    {
+        if (old_handle == hydra::BAD_CHEAT)
+        {
+            return AddCheats({cheat})[0];
+        }
+
+        uint32_t handle;
+        {
+            std::unique_lock<std::mutex> core_lock = LockCore();
+            std::unique_lock<std::mutex> lock(cheats_mutex_);
+            auto it = cheat_index_.find(old_handle);
+            if (it == cheat_index_.end())
+                return hydra::BAD_CHEAT;
+
+            size_t index = it->second;
+            shell->asICheat()->removeCheat(old_handle);
+            handle = add_cheat(hydra::hex_to_bytes(cheat.code), cheat.enabled);
+            if (handle == hydra::BAD_CHEAT)
             {
-                if (cheat_metadata.handle == old_handle)
-                {
-                    ICheat* cheat_interface = shell->asICheat();
-                    cheat_interface->removeCheat(old_handle);
-                    std::vector<uint8_t> bytes = hydra::hex_to_bytes(cheat.code);
-                    uint32_t handle = cheat_interface->addCheat(bytes.data(), bytes.size());
-                    if (handle != hydra::BAD_CHEAT)
-                    {
-                        cheat_metadata = cheat;
-                        cheat_metadata.handle = handle;
-                        return handle;
-                    }
-                    return hydra::BAD_CHEAT;
-                }
+                // The old code is gone from the core already
+                erase_cheat(index);
+            }
+            else
+            {
+                cheat_index_.erase(it);
+                cheat_index_[handle] = index;
+                cheats_[index] = cheat;
+                cheats_[index].handle = handle;
             }
-            return hydra::BAD_CHEAT;
         }
+        mark_cheats_dirty();
+        return handle;
     }
 
     void EmulatorWrapper::RemoveCheat(uint32_t handle)
     {
-        ICheat* cheat_interface = shell->asICheat();
-        cheat_interface->removeCheat(handle);
-        for (auto it = cheats_.begin(); it != cheats_.end(); ++it)
         {
-            if (it->handle == handle)
-            {
-                cheats_.erase(it);
-                save_cheats();
+            std::unique_lock<std::mutex> core_lock = LockCore();
+            shell->asICheat()->removeCheat(handle);
+        }
+        {
+            std::unique_lock<std::mutex> lock(cheats_mutex_);
+            auto it = cheat_index_.find(handle);
+            if (it == cheat_index_.end())
                 return;
-            }
+            erase_cheat(it->second);
         }
+        mark_cheats_dirty();
     }
 
     void EmulatorWrapper::EnableCheat(uint32_t handle)
     {
-        ICheat* cheat_interface = shell->asICheat();
-        cheat_interface->enableCheat(handle);
-        for (auto& cheat : cheats_)
         {
-            if (cheat.handle == handle)
-            {
-                cheat.enabled = true;
-                save_cheats();
+            std::unique_lock<std::mutex> core_lock = LockCore();
+            shell->asICheat()->enableCheat(handle);
+        }
+        {
+            std::unique_lock<std::mutex> lock(cheats_mutex_);
+            CheatMetadata* cheat = find_cheat(handle);
+            if (!cheat)
                 return;
-            }
+            cheat->enabled = true;
         }
+        mark_cheats_dirty();
     }
 
     void EmulatorWrapper::DisableCheat(uint32_t handle)
     {
-        ICheat* cheat_interface = shell->asICheat();
-        cheat_interface->disableCheat(handle);
-        for (auto& cheat : cheats_)
         {
-            if (cheat.handle == handle)
-            {
-                cheat.enabled = false;
-                save_cheats();
+            std::unique_lock<std::mutex> core_lock = LockCore();
+            shell->asICheat()->disableCheat(handle);
+        }
+        {
+            std::unique_lock<std::mutex> lock(cheats_mutex_);
+            CheatMetadata* cheat = find_cheat(handle);
+            if (!cheat)
                 return;
-            }
+            cheat->enabled = false;
         }
+        mark_cheats_dirty();
     }
-} // namespace hydra
\ No newline at end of file
+} // namespace hydra
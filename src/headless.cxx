@@ -0,0 +1,219 @@
+#include <algorithm>
+#include <chrono>
+#include <corewrapper.hxx>
+#include <cstring>
+#include <filesystem>
+#include <fmt/format.h>
+#include <framepool.hxx>
+#include <headless.hxx>
+#include <hydra/core.hxx>
+#include <log.h>
+#include <ringbuffer.hxx>
+#include <settings.hxx>
+#include <vector>
+
+namespace
+{
+    using bench_clock = std::chrono::steady_clock;
+
+    // The callbacks do the same work the qt frontend does, copy the frame into a slot and push
+    // the samples through a ring buffer, so that their cost is representative
+    hydra::FramePool frame_pool;
+    hydra::ringbuffer<1 << 20> audio_buffer;
+    std::vector<uint8_t> audio_scratch(1 << 20);
+    size_t audio_frame_size = 0;
+
+    uint64_t video_ns = 0;
+    uint64_t video_calls = 0;
+    uint64_t audio_ns = 0;
+    uint64_t audio_calls = 0;
+
+    uint64_t elapsed_ns(bench_clock::time_point start)
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now() - start)
+            .count();
+    }
+
+    void video_callback(void* data, hydra::Size size)
+    {
+        auto start = bench_clock::now();
+        if (data)
+        {
+            hydra::FramePool::Slot& slot = frame_pool.WriteSlot();
+            slot.width = size.width;
+            slot.height = size.height;
+            slot.data.resize(size.width * size.height * 4);
+            std::memcpy(slot.data.data(), data, slot.data.size());
+            frame_pool.Publish();
+            frame_pool.Acquire();
+        }
+        video_ns += elapsed_ns(start);
+        video_calls++;
+    }
+
+    void audio_callback(void* data, size_t frames)
+    {
+        auto start = bench_clock::now();
+        size_t written = audio_buffer.write(data, frames * audio_frame_size);
+        // Nothing plays the samples back, drain them like a device would
+        audio_buffer.read(audio_scratch.data(), std::min(written, audio_scratch.size()));
+        audio_ns += elapsed_ns(start);
+        audio_calls++;
+    }
+
+    int32_t read_input_callback(uint32_t, hydra::ButtonType)
+    {
+        return 0;
+    }
+
+    void poll_input_callback() {}
+
+    std::string find_core(const std::filesystem::path& rom, const char* core_name)
+    {
+        for (const auto& core : Settings::CoreInfo())
+        {
+            if (core_name)
+            {
+                std::string filename = std::filesystem::path(core.path).filename().string();
+                if (core.core_name == core_name || filename == core_name)
+                    return core.path;
+                continue;
+            }
+
+            std::string extension = rom.extension().string();
+            for (const auto& ext : core.extensions)
+            {
+                if (!extension.empty() && extension.substr(1) == ext)
+                    return core.path;
+            }
+        }
+        return {};
+    }
+
+    double percentile(const std::vector<uint64_t>& sorted, double p)
+    {
+        size_t index = static_cast<size_t>(p / 100.0 * (sorted.size() - 1));
+        return sorted[index] / 1000.0;
+    }
+} // namespace
+
+int main_headless(const char* rom_path, const char* core_name, int frames, float seconds)
+{
+    if (!rom_path)
+    {
+        printf("The headless frontend needs a file to open, use --open-file\n");
+        return 1;
+    }
+
+    std::filesystem::path rom(rom_path);
+    std::string core_path = find_core(rom, core_name);
+    if (core_path.empty())
+    {
+        printf("Failed to find a core for %s\n", rom_path);
+        return 1;
+    }
+
+    auto emulator = hydra::EmulatorFactory::Create(core_path);
+    if (!emulator)
+        return 1;
+
+    hydra::IBase* shell = emulator->shell;
+    if (shell->hasInterface(hydra::InterfaceType::IOpenGlRendered))
+    {
+        printf("The headless frontend only supports software rendered cores\n");
+        return 1;
+    }
+
+    if (!shell->hasInterface(hydra::InterfaceType::IFrontendDriven))
+    {
+        printf("The headless frontend only supports frontend driven cores\n");
+        return 1;
+    }
+
+    if (shell->hasInterface(hydra::InterfaceType::ISoftwareRendered))
+    {
+        shell->asISoftwareRendered()->setVideoCallback(video_callback);
+    }
+
+    if (shell->hasInterface(hydra::InterfaceType::IAudio))
+    {
+        hydra::IAudio* shell_audio = shell->asIAudio();
+        shell_audio->setAudioCallback(audio_callback);
+        size_t sample_size =
+            shell_audio->getSampleType() == hydra::SampleType::Int16 ? sizeof(int16_t) : sizeof(float);
+        audio_frame_size = sample_size * static_cast<int>(shell_audio->getChannelType());
+    }
+
+    if (shell->hasInterface(hydra::InterfaceType::IInput))
+    {
+        hydra::IInput* shell_input = shell->asIInput();
+        shell_input->setPollInputCallback(poll_input_callback);
+        shell_input->setCheckButtonCallback(read_input_callback);
+    }
+
+    if (shell->hasInterface(hydra::InterfaceType::ILog))
+    {
+        hydra::ILog* shell_log = shell->asILog();
+        shell_log->setLogCallback(hydra::LogTarget::Warning, log_warn);
+        shell_log->setLogCallback(hydra::LogTarget::Info, log_info);
+        shell_log->setLogCallback(hydra::LogTarget::Debug, log_debug);
+        shell_log->setLogCallback(hydra::LogTarget::Error, log_fatal);
+    }
+
+    std::string name = emulator->GetInfo(hydra::InfoType::CoreName);
+    for (const auto& file : hydra::split(emulator->GetInfo(hydra::InfoType::Firmware), ','))
+    {
+        std::string path = Settings::Get(name + "_" + file);
+        if (path.empty())
+        {
+            printf("Firmware file %s not set in settings\n", file.c_str());
+            return 1;
+        }
+        shell->loadFile(file.c_str(), path.c_str());
+    }
+
+    if (!emulator->LoadGame(rom))
+    {
+        printf("Failed to load %s\n", rom_path);
+        return 1;
+    }
+
+    if (frames <= 0)
+        frames = 1000;
+
+    auto deadline = bench_clock::now() + std::chrono::duration_cast<bench_clock::duration>(
+                                             std::chrono::duration<float>(seconds));
+    std::vector<uint64_t> frame_times;
+    frame_times.reserve(seconds > 0 ? 1 << 16 : frames);
+    hydra::IFrontendDriven* shell_fd = shell->asIFrontendDriven();
+
+    auto start = bench_clock::now();
+    while (seconds > 0 ? bench_clock::now() < deadline : frame_times.size() < (size_t)frames)
+    {
+        auto frame_start = bench_clock::now();
+        shell_fd->runFrame();
+        frame_times.push_back(elapsed_ns(frame_start));
+    }
+    double total = elapsed_ns(start) / 1e9;
+    if (frame_times.empty())
+    {
+        printf("No frames were run, nothing to report\n");
+        return 1;
+    }
+
+    std::sort(frame_times.begin(), frame_times.end());
+    printf("%s", fmt::format("core: {}\n"
+                             "file: {}\n"
+                             "frames: {} in {:.3f}s\n"
+                             "fps: {:.2f} (target {})\n"
+                             "frame time us: p50 {:.1f}, p90 {:.1f}, p99 {:.1f}, max {:.1f}\n"
+                             "video callback: {} calls, {:.3f}ms total\n"
+                             "audio callback: {} calls, {:.3f}ms total\n",
+                             name, rom_path, frame_times.size(), total,
+                             frame_times.size() / total, shell_fd->getFps(),
+                             percentile(frame_times, 50), percentile(frame_times, 90),
+                             percentile(frame_times, 99), frame_times.back() / 1000.0,
+                             video_calls, video_ns / 1e6, audio_calls, audio_ns / 1e6)
+                     .c_str());
+    return 0;
+}
@@ -2,11 +2,13 @@
 #include <argparse/argparse.h>
 #include <bot.hxx>
 #include <filesystem>
+#include <headless.hxx>
 #include <log.h>
 #include <QApplication>
 #include <QSurfaceFormat>
 #include <settings.hxx>
 #include <update.hxx>
+#include <vector>
 
 // clang-format off
 
@@ -22,6 +24,11 @@ const char* options =
 const char* frontend = "qt";
 const char* rom_path = nullptr;
 const char* core_name = nullptr;
+const char* sync_mode = nullptr;
+int bench_frames = 0;
+float bench_seconds = 0;
+// Set by the options that do one thing and exit instead of starting a frontend
+bool command_ran = false;
 
 int main_qt(int argc, char* argv[])
 {
@@ -41,6 +48,10 @@ int main_qt(int argc, char* argv[])
     {
         w.OpenFile(argv[1]);
     }
+    else if (rom_path)
+    {
+        w.OpenFile(rom_path);
+    }
 
     return a.exec();
     ;
@@ -48,16 +59,22 @@ int main_qt(int argc, char* argv[])
 
 int version_cb(struct argparse*, const struct argparse_option*)
 {
+    command_ran = true;
     std::cout << "hydra version " << HYDRA_VERSION << std::endl;
     return 0;
 }
 
-int start_frontend_cb(struct argparse* self, const struct argparse_option*)
+// Runs after every option was parsed, so their order on the command line doesn't matter
+int start_frontend(int argc, char* argv[])
 {
     std::string frontend_str(frontend);
     if (frontend_str == "qt")
     {
-        return main_qt(self->argc, const_cast<char**>(self->argv));
+        return main_qt(argc, argv);
+    }
+    else if (frontend_str == "headless")
+    {
+        return main_headless(rom_path, core_name, bench_frames, bench_seconds);
     }
     else
     {
@@ -66,8 +83,21 @@ int start_frontend_cb(struct argparse* self, const struct argparse_option*)
     }
 }
 
+int sync_mode_cb(struct argparse*, const struct argparse_option*)
+{
+    std::string sync_mode_str(sync_mode);
+    if (sync_mode_str != "video" && sync_mode_str != "audio" && sync_mode_str != "free")
+    {
+        std::cout << "Unknown sync mode: " << sync_mode << std::endl;
+        exit(1);
+    }
+    hydra::setting::sync_mode_override = sync_mode_str;
+    return 0;
+}
+
 int print_settings_cb(struct argparse*, const struct argparse_option*)
 {
+    command_ran = true;
     std::cout << Settings::Print() << std::endl;
     return 0;
 }
@@ -81,6 +111,7 @@ int help_cb(struct argparse* self, const struct argparse_option* option)
 
 int list_cores_cb(struct argparse*, const struct argparse_option*)
 {
+    command_ran = true;
     Settings::InitCoreInfo();
     for (auto& info : Settings::CoreInfo())
     {
@@ -93,6 +124,7 @@ int list_cores_cb(struct argparse*, const struct argparse_option*)
 
 int bot_main_cb(struct argparse*, const struct argparse_option*)
 {
+    command_ran = true;
     return bot_main();
 }
 
@@ -120,13 +152,24 @@ int main(int argc, char* argv[])
         OPT_BOOLEAN('l', "list-cores", nullptr, nullptr, list_cores_cb),
         OPT_BOOLEAN('v', "version", nullptr, nullptr, version_cb),
         OPT_STRING('p', "print-settings", nullptr, nullptr, print_settings_cb),
-        OPT_STRING('f', "frontend", &frontend, nullptr, start_frontend_cb),
+        OPT_STRING('s', "sync-mode", &sync_mode, nullptr, sync_mode_cb),
+        OPT_INTEGER('n', "frames", &bench_frames, nullptr, nullptr),
+        OPT_FLOAT('t', "seconds", &bench_seconds, nullptr, nullptr),
+        OPT_STRING('f', "frontend", &frontend, nullptr, nullptr),
         OPT_END(),
     };
 
     struct argparse argparse;
     argparse_init(&argparse, options, usages, 0);
     argparse_describe(&argparse, "\nThe hydra emulator", nullptr);
-    argparse_parse(&argparse, argc, const_cast<const char**>(argv));
-    return 0;
+    // argparse moves the arguments that aren't options to the front and drops the program name
+    char* program = argv[0];
+    int remaining = argparse_parse(&argparse, argc, const_cast<const char**>(argv));
+    if (command_ran)
+        return 0;
+
+    std::vector<char*> frontend_argv = {program};
+    frontend_argv.insert(frontend_argv.end(), argv, argv + remaining);
+    frontend_argv.push_back(nullptr);
+    return start_frontend(frontend_argv.size() - 1, frontend_argv.data());
 }
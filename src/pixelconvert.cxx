@@ -0,0 +1,640 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <pixelconvert.hxx>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define HYDRA_PIXEL_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+// MSVC allows any intrinsic without flags
+#define HYDRA_TARGET(isa)
+#else
+#define HYDRA_TARGET(isa) __attribute__((target(isa)))
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define HYDRA_PIXEL_NEON
+#include <arm_neon.h>
+#endif
+
+namespace
+{
+    using hydra::pixel::Swizzle;
+
+    // Scalar implementations, the reference for the vector ones which also use them for the
+    // pixels that don't fill a whole register
+
+    void swizzle_scalar(uint8_t* dst, const uint8_t* src, size_t pixels, Swizzle order)
+    {
+        for (size_t i = 0; i < pixels; i++)
+        {
+            uint8_t pixel[4];
+            std::memcpy(pixel, src + i * 4, 4);
+            dst[i * 4 + 0] = pixel[order[0]];
+            dst[i * 4 + 1] = pixel[order[1]];
+            dst[i * 4 + 2] = pixel[order[2]];
+            dst[i * 4 + 3] = pixel[order[3]];
+        }
+    }
+
+    void fill_alpha_scalar(uint8_t* data, size_t pixels, uint8_t alpha)
+    {
+        for (size_t i = 0; i < pixels; i++)
+        {
+            data[i * 4 + 3] = alpha;
+        }
+    }
+
+    void rgba_to_rgb565_scalar(uint16_t* dst, const uint8_t* src, size_t pixels)
+    {
+        for (size_t i = 0; i < pixels; i++)
+        {
+            const uint8_t* p = src + i * 4;
+            dst[i] = ((p[0] >> 3) << 11) | ((p[1] >> 2) << 5) | (p[2] >> 3);
+        }
+    }
+
+    void rgb565_to_rgba_scalar(uint8_t* dst, const uint16_t* src, size_t pixels)
+    {
+        for (size_t i = 0; i < pixels; i++)
+        {
+            uint16_t pixel = src[i];
+            uint8_t r = (pixel >> 11) & 0x1F;
+            uint8_t g = (pixel >> 5) & 0x3F;
+            uint8_t b = pixel & 0x1F;
+            // Replicate the high bits into the low ones so that full intensity stays 0xFF
+            dst[i * 4 + 0] = (r << 3) | (r >> 2);
+            dst[i * 4 + 1] = (g << 2) | (g >> 4);
+            dst[i * 4 + 2] = (b << 3) | (b >> 2);
+            dst[i * 4 + 3] = 0xFF;
+        }
+    }
+
+    // Widens one row by factor
+    void scale_row_scalar(uint8_t* dst, const uint8_t* src, size_t width, size_t factor)
+    {
+        for (size_t x = 0; x < width; x++)
+        {
+            for (size_t i = 0; i < factor; i++)
+            {
+                std::memcpy(dst, src + x * 4, 4);
+                dst += 4;
+            }
+        }
+    }
+
+    void scale_row_2x_scalar(uint8_t* dst, const uint8_t* src, size_t width)
+    {
+        scale_row_scalar(dst, src, width, 2);
+    }
+
+    struct Backend
+    {
+        const char* name;
+        void (*swizzle)(uint8_t*, const uint8_t*, size_t, Swizzle);
+        void (*fill_alpha)(uint8_t*, size_t, uint8_t);
+        void (*rgba_to_rgb565)(uint16_t*, const uint8_t*, size_t);
+        void (*rgb565_to_rgba)(uint8_t*, const uint16_t*, size_t);
+        void (*scale_row_2x)(uint8_t*, const uint8_t*, size_t);
+    };
+
+    constexpr Backend scalar_backend = {
+        "scalar",
+        swizzle_scalar,
+        fill_alpha_scalar,
+        rgba_to_rgb565_scalar,
+        rgb565_to_rgba_scalar,
+        scale_row_2x_scalar,
+    };
+
+#ifdef HYDRA_PIXEL_X86
+    // Builds the byte shuffle mask that applies order to every pixel of a 16 byte register
+    Swizzle::value_type shuffle_index(Swizzle order, int byte)
+    {
+        return (byte & ~3) + order[byte & 3];
+    }
+
+    HYDRA_TARGET("sse2")
+    void swizzle_sse2(uint8_t* dst, const uint8_t* src, size_t pixels, Swizzle order)
+    {
+        // SSE2 has no byte shuffle, only the two swizzles the frontend actually uses are
+        // done with shifts
+        size_t i = 0;
+        if (order == hydra::pixel::swizzle_reverse)
+        {
+            for (; i + 4 <= pixels; i += 4)
+            {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+                // Swap the bytes of every 16 bit half, then swap the halves
+                v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+                v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+                v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), v);
+            }
+        }
+        else if (order == hydra::pixel::swizzle_rb)
+        {
+            const __m128i ga_mask = _mm_set1_epi32(0xFF00FF00);
+            const __m128i low_mask = _mm_set1_epi32(0x000000FF);
+            for (; i + 4 <= pixels; i += 4)
+            {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+                __m128i ga = _mm_and_si128(v, ga_mask);
+                __m128i r = _mm_slli_epi32(_mm_and_si128(v, low_mask), 16);
+                __m128i b = _mm_and_si128(_mm_srli_epi32(v, 16), low_mask);
+                v = _mm_or_si128(ga, _mm_or_si128(r, b));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), v);
+            }
+        }
+        swizzle_scalar(dst + i * 4, src + i * 4, pixels - i, order);
+    }
+
+    HYDRA_TARGET("ssse3")
+    void swizzle_ssse3(uint8_t* dst, const uint8_t* src, size_t pixels, Swizzle order)
+    {
+        const __m128i mask = _mm_setr_epi8(
+            shuffle_index(order, 0), shuffle_index(order, 1), shuffle_index(order, 2),
+            shuffle_index(order, 3), shuffle_index(order, 4), shuffle_index(order, 5),
+            shuffle_index(order, 6), shuffle_index(order, 7), shuffle_index(order, 8),
+            shuffle_index(order, 9), shuffle_index(order, 10), shuffle_index(order, 11),
+            shuffle_index(order, 12), shuffle_index(order, 13), shuffle_index(order, 14),
+            shuffle_index(order, 15));
+        size_t i = 0;
+        for (; i + 4 <= pixels; i += 4)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_shuffle_epi8(v, mask));
+        }
+        swizzle_scalar(dst + i * 4, src + i * 4, pixels - i, order);
+    }
+
+    HYDRA_TARGET("sse2")
+    void fill_alpha_sse2(uint8_t* data, size_t pixels, uint8_t alpha)
+    {
+        const __m128i color_mask = _mm_set1_epi32(0x00FFFFFF);
+        const __m128i alpha_bits = _mm_set1_epi32(static_cast<uint32_t>(alpha) << 24);
+        size_t i = 0;
+        for (; i + 4 <= pixels; i += 4)
+        {
+            __m128i* p = reinterpret_cast<__m128i*>(data + i * 4);
+            __m128i v = _mm_and_si128(_mm_loadu_si128(p), color_mask);
+            _mm_storeu_si128(p, _mm_or_si128(v, alpha_bits));
+        }
+        fill_alpha_scalar(data + i * 4, pixels - i, alpha);
+    }
+
+    // 4 RGBA pixels to 4 RGB565 values, each in the low half of a 32 bit lane
+    HYDRA_TARGET("sse2")
+    __m128i pack_rgb565_sse2(__m128i v)
+    {
+        const __m128i mask5 = _mm_set1_epi32(0xF8);
+        const __m128i mask6 = _mm_set1_epi32(0xFC);
+        __m128i r = _mm_slli_epi32(_mm_and_si128(v, mask5), 8);
+        __m128i g = _mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(v, 8), mask6), 3);
+        __m128i b = _mm_srli_epi32(_mm_and_si128(_mm_srli_epi32(v, 16), mask5), 3);
+        __m128i packed = _mm_or_si128(r, _mm_or_si128(g, b));
+        // Sign extend so the saturating 32 -> 16 bit pack keeps the bits as they are
+        return _mm_srai_epi32(_mm_slli_epi32(packed, 16), 16);
+    }
+
+    HYDRA_TARGET("sse2")
+    void rgba_to_rgb565_sse2(uint16_t* dst, const uint8_t* src, size_t pixels)
+    {
+        size_t i = 0;
+        for (; i + 8 <= pixels; i += 8)
+        {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4 + 16));
+            __m128i packed = _mm_packs_epi32(pack_rgb565_sse2(a), pack_rgb565_sse2(b));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), packed);
+        }
+        rgba_to_rgb565_scalar(dst + i, src + i * 4, pixels - i);
+    }
+
+    // 4 RGB565 values, each in a 32 bit lane, to 4 RGBA pixels
+    HYDRA_TARGET("sse2")
+    __m128i unpack_rgb565_sse2(__m128i v)
+    {
+        __m128i r = _mm_and_si128(_mm_srli_epi32(v, 11), _mm_set1_epi32(0x1F));
+        __m128i g = _mm_and_si128(_mm_srli_epi32(v, 5), _mm_set1_epi32(0x3F));
+        __m128i b = _mm_and_si128(v, _mm_set1_epi32(0x1F));
+        r = _mm_or_si128(_mm_slli_epi32(r, 3), _mm_srli_epi32(r, 2));
+        g = _mm_or_si128(_mm_slli_epi32(g, 2), _mm_srli_epi32(g, 4));
+        b = _mm_or_si128(_mm_slli_epi32(b, 3), _mm_srli_epi32(b, 2));
+        __m128i rgba = _mm_or_si128(r, _mm_slli_epi32(g, 8));
+        rgba = _mm_or_si128(rgba, _mm_slli_epi32(b, 16));
+        return _mm_or_si128(rgba, _mm_set1_epi32(0xFF000000));
+    }
+
+    HYDRA_TARGET("sse2")
+    void rgb565_to_rgba_sse2(uint8_t* dst, const uint16_t* src, size_t pixels)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        size_t i = 0;
+        for (; i + 8 <= pixels; i += 8)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            __m128i low = unpack_rgb565_sse2(_mm_unpacklo_epi16(v, zero));
+            __m128i high = unpack_rgb565_sse2(_mm_unpackhi_epi16(v, zero));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), low);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4 + 16), high);
+        }
+        rgb565_to_rgba_scalar(dst + i * 4, src + i, pixels - i);
+    }
+
+    HYDRA_TARGET("sse2")
+    void scale_row_2x_sse2(uint8_t* dst, const uint8_t* src, size_t width)
+    {
+        size_t x = 0;
+        for (; x + 4 <= width; x += 4)
+        {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x * 4));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 8), _mm_unpacklo_epi32(v, v));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x * 8 + 16),
+                             _mm_unpackhi_epi32(v, v));
+        }
+        scale_row_scalar(dst + x * 8, src + x * 4, width - x, 2);
+    }
+
+    HYDRA_TARGET("avx2")
+    void swizzle_avx2(uint8_t* dst, const uint8_t* src, size_t pixels, Swizzle order)
+    {
+        // The shuffle works within each 128 bit lane, which is fine since pixels never cross them
+        const __m256i mask = _mm256_setr_epi8(
+            shuffle_index(order, 0), shuffle_index(order, 1), shuffle_index(order, 2),
+            shuffle_index(order, 3), shuffle_index(order, 4), shuffle_index(order, 5),
+            shuffle_index(order, 6), shuffle_index(order, 7), shuffle_index(order, 8),
+            shuffle_index(order, 9), shuffle_index(order, 10), shuffle_index(order, 11),
+            shuffle_index(order, 12), shuffle_index(order, 13), shuffle_index(order, 14),
+            shuffle_index(order, 15), shuffle_index(order, 0), shuffle_index(order, 1),
+            shuffle_index(order, 2), shuffle_index(order, 3), shuffle_index(order, 4),
+            shuffle_index(order, 5), shuffle_index(order, 6), shuffle_index(order, 7),
+            shuffle_index(order, 8), shuffle_index(order, 9), shuffle_index(order, 10),
+            shuffle_index(order, 11), shuffle_index(order, 12), shuffle_index(order, 13),
+            shuffle_index(order, 14), shuffle_index(order, 15));
+        size_t i = 0;
+        for (; i + 8 <= pixels; i += 8)
+        {
+            __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4),
+                                _mm256_shuffle_epi8(v, mask));
+        }
+        swizzle_ssse3(dst + i * 4, src + i * 4, pixels - i, order);
+    }
+
+    HYDRA_TARGET("avx2")
+    void fill_alpha_avx2(uint8_t* data, size_t pixels, uint8_t alpha)
+    {
+        const __m256i color_mask = _mm256_set1_epi32(0x00FFFFFF);
+        const __m256i alpha_bits = _mm256_set1_epi32(static_cast<uint32_t>(alpha) << 24);
+        size_t i = 0;
+        for (; i + 8 <= pixels; i += 8)
+        {
+            __m256i* p = reinterpret_cast<__m256i*>(data + i * 4);
+            __m256i v = _mm256_and_si256(_mm256_loadu_si256(p), color_mask);
+            _mm256_storeu_si256(p, _mm256_or_si256(v, alpha_bits));
+        }
+        fill_alpha_sse2(data + i * 4, pixels - i, alpha);
+    }
+
+    HYDRA_TARGET("avx2")
+    __m256i pack_rgb565_avx2(__m256i v)
+    {
+        const __m256i mask5 = _mm256_set1_epi32(0xF8);
+        const __m256i mask6 = _mm256_set1_epi32(0xFC);
+        __m256i r = _mm256_slli_epi32(_mm256_and_si256(v, mask5), 8);
+        __m256i g = _mm256_slli_epi32(_mm256_and_si256(_mm256_srli_epi32(v, 8), mask6), 3);
+        __m256i b = _mm256_srli_epi32(_mm256_and_si256(_mm256_srli_epi32(v, 16), mask5), 3);
+        __m256i packed = _mm256_or_si256(r, _mm256_or_si256(g, b));
+        return _mm256_srai_epi32(_mm256_slli_epi32(packed, 16), 16);
+    }
+
+    HYDRA_TARGET("avx2")
+    void rgba_to_rgb565_avx2(uint16_t* dst, const uint8_t* src, size_t pixels)
+    {
+        size_t i = 0;
+        for (; i + 16 <= pixels; i += 16)
+        {
+            __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4));
+            __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4 + 32));
+            __m256i packed = _mm256_packs_epi32(pack_rgb565_avx2(a), pack_rgb565_avx2(b));
+            // The pack works per 128 bit lane, put the quarters back in order
+            packed = _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), packed);
+        }
+        rgba_to_rgb565_sse2(dst + i, src + i * 4, pixels - i);
+    }
+
+    HYDRA_TARGET("avx2")
+    void rgb565_to_rgba_avx2(uint8_t* dst, const uint16_t* src, size_t pixels)
+    {
+        size_t i = 0;
+        for (; i + 8 <= pixels; i += 8)
+        {
+            __m256i v = _mm256_cvtepu16_epi32(
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)));
+            __m256i r = _mm256_and_si256(_mm256_srli_epi32(v, 11), _mm256_set1_epi32(0x1F));
+            __m256i g = _mm256_and_si256(_mm256_srli_epi32(v, 5), _mm256_set1_epi32(0x3F));
+            __m256i b = _mm256_and_si256(v, _mm256_set1_epi32(0x1F));
+            r = _mm256_or_si256(_mm256_slli_epi32(r, 3), _mm256_srli_epi32(r, 2));
+            g = _mm256_or_si256(_mm256_slli_epi32(g, 2), _mm256_srli_epi32(g, 4));
+            b = _mm256_or_si256(_mm256_slli_epi32(b, 3), _mm256_srli_epi32(b, 2));
+            __m256i rgba = _mm256_or_si256(r, _mm256_slli_epi32(g, 8));
+            rgba = _mm256_or_si256(rgba, _mm256_slli_epi32(b, 16));
+            rgba = _mm256_or_si256(rgba, _mm256_set1_epi32(0xFF000000));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), rgba);
+        }
+        rgb565_to_rgba_sse2(dst + i * 4, src + i, pixels - i);
+    }
+
+    constexpr Backend sse2_backend = {
+        "SSE2",
+        swizzle_sse2,
+        fill_alpha_sse2,
+        rgba_to_rgb565_sse2,
+        rgb565_to_rgba_sse2,
+        scale_row_2x_sse2,
+    };
+
+    constexpr Backend ssse3_backend = {
+        "SSSE3",
+        swizzle_ssse3,
+        fill_alpha_sse2,
+        rgba_to_rgb565_sse2,
+        rgb565_to_rgba_sse2,
+        scale_row_2x_sse2,
+    };
+
+    constexpr Backend avx2_backend = {
+        "AVX2",
+        swizzle_avx2,
+        fill_alpha_avx2,
+        rgba_to_rgb565_avx2,
+        rgb565_to_rgba_avx2,
+        scale_row_2x_sse2,
+    };
+
+    enum class X86Feature
+    {
+        SSE2,
+        SSSE3,
+        AVX2,
+    };
+
+    bool cpu_supports(X86Feature feature)
+    {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 1);
+        switch (feature)
+        {
+            case X86Feature::SSE2:
+                return info[3] & (1 << 26);
+            case X86Feature::SSSE3:
+                return info[2] & (1 << 9);
+            case X86Feature::AVX2:
+            {
+                // The OS also has to save the ymm registers on context switches
+                bool osxsave = info[2] & (1 << 27);
+                bool avx = info[2] & (1 << 28);
+                if (!osxsave || !avx || (_xgetbv(0) & 0x6) != 0x6)
+                    return false;
+                __cpuidex(info, 7, 0);
+                return info[1] & (1 << 5);
+            }
+        }
+        return false;
+#else
+        switch (feature)
+        {
+            case X86Feature::SSE2:
+                return __builtin_cpu_supports("sse2");
+            case X86Feature::SSSE3:
+                return __builtin_cpu_supports("ssse3");
+            case X86Feature::AVX2:
+                return __builtin_cpu_supports("avx2");
+        }
+        return false;
+#endif
+    }
+
+    // Slowest first, the last one is the default
+    std::vector<const Backend*> supported_backends()
+    {
+        std::vector<const Backend*> backends = {&scalar_backend};
+        if (cpu_supports(X86Feature::SSE2))
+            backends.push_back(&sse2_backend);
+        if (cpu_supports(X86Feature::SSSE3))
+            backends.push_back(&ssse3_backend);
+        if (cpu_supports(X86Feature::AVX2))
+            backends.push_back(&avx2_backend);
+        return backends;
+    }
+#elif defined(HYDRA_PIXEL_NEON)
+    void swizzle_neon(uint8_t* dst, const uint8_t* src, size_t pixels, Swizzle order)
+    {
+        uint8_t indices[16];
+        for (int i = 0; i < 16; i++)
+            indices[i] = (i & ~3) + order[i & 3];
+        const uint8x16_t mask = vld1q_u8(indices);
+        size_t i = 0;
+        for (; i + 4 <= pixels; i += 4)
+        {
+            vst1q_u8(dst + i * 4, vqtbl1q_u8(vld1q_u8(src + i * 4), mask));
+        }
+        swizzle_scalar(dst + i * 4, src + i * 4, pixels - i, order);
+    }
+
+    void fill_alpha_neon(uint8_t* data, size_t pixels, uint8_t alpha)
+    {
+        const uint32x4_t color_mask = vdupq_n_u32(0x00FFFFFF);
+        const uint32x4_t alpha_bits = vdupq_n_u32(static_cast<uint32_t>(alpha) << 24);
+        size_t i = 0;
+        for (; i + 4 <= pixels; i += 4)
+        {
+            uint32_t* p = reinterpret_cast<uint32_t*>(data + i * 4);
+            vst1q_u32(p, vorrq_u32(vandq_u32(vld1q_u32(p), color_mask), alpha_bits));
+        }
+        fill_alpha_scalar(data + i * 4, pixels - i, alpha);
+    }
+
+    void rgba_to_rgb565_neon(uint16_t* dst, const uint8_t* src, size_t pixels)
+    {
+        size_t i = 0;
+        for (; i + 8 <= pixels; i += 8)
+        {
+            uint8x8x4_t rgba = vld4_u8(src + i * 4);
+            // Shift each channel into the top of a 16 bit lane and insert them below each other
+            uint16x8_t packed = vshll_n_u8(rgba.val[0], 8);
+            packed = vsriq_n_u16(packed, vshll_n_u8(rgba.val[1], 8), 5);
+            packed = vsriq_n_u16(packed, vshll_n_u8(rgba.val[2], 8), 11);
+            vst1q_u16(dst + i, packed);
+        }
+        rgba_to_rgb565_scalar(dst + i, src + i * 4, pixels - i);
+    }
+
+    void rgb565_to_rgba_neon(uint8_t* dst, const uint16_t* src, size_t pixels)
+    {
+        size_t i = 0;
+        for (; i + 8 <= pixels; i += 8)
+        {
+            uint16x8_t v = vld1q_u16(src + i);
+            // Move each channel to the top of the low byte, then copy its high bits to the bottom
+            uint8x8_t r = vand_u8(vshrn_n_u16(v, 8), vdup_n_u8(0xF8));
+            uint8x8_t g = vand_u8(vshrn_n_u16(vshlq_n_u16(v, 5), 8), vdup_n_u8(0xFC));
+            uint8x8_t b = vand_u8(vshrn_n_u16(vshlq_n_u16(v, 11), 8), vdup_n_u8(0xF8));
+            uint8x8x4_t rgba;
+            rgba.val[0] = vorr_u8(r, vshr_n_u8(r, 5));
+            rgba.val[1] = vorr_u8(g, vshr_n_u8(g, 6));
+            rgba.val[2] = vorr_u8(b, vshr_n_u8(b, 5));
+            rgba.val[3] = vdup_n_u8(0xFF);
+            vst4_u8(dst + i * 4, rgba);
+        }
+        rgb565_to_rgba_scalar(dst + i * 4, src + i, pixels - i);
+    }
+
+    void scale_row_2x_neon(uint8_t* dst, const uint8_t* src, size_t width)
+    {
+        size_t x = 0;
+        for (; x + 4 <= width; x += 4)
+        {
+            uint32x4_t v = vld1q_u32(reinterpret_cast<const uint32_t*>(src + x * 4));
+            uint32x4x2_t doubled = vzipq_u32(v, v);
+            vst1q_u32(reinterpret_cast<uint32_t*>(dst + x * 8), doubled.val[0]);
+            vst1q_u32(reinterpret_cast<uint32_t*>(dst + x * 8 + 16), doubled.val[1]);
+        }
+        scale_row_scalar(dst + x * 8, src + x * 4, width - x, 2);
+    }
+
+    constexpr Backend neon_backend = {
+        "NEON",
+        swizzle_neon,
+        fill_alpha_neon,
+        rgba_to_rgb565_neon,
+        rgb565_to_rgba_neon,
+        scale_row_2x_neon,
+    };
+
+    std::vector<const Backend*> supported_backends()
+    {
+        // NEON is part of the baseline on aarch64
+        return {&scalar_backend, &neon_backend};
+    }
+#else
+    std::vector<const Backend*> supported_backends()
+    {
+        return {&scalar_backend};
+    }
+#endif
+
+    std::atomic<const Backend*>& active_backend()
+    {
+        static std::atomic<const Backend*> backend = supported_backends().back();
+        return backend;
+    }
+
+    const Backend& backend()
+    {
+        return *active_backend().load(std::memory_order_relaxed);
+    }
+} // namespace
+
+namespace hydra::pixel
+{
+    void swizzle(uint8_t* dst, const uint8_t* src, size_t pixels, Swizzle order)
+    {
+        backend().swizzle(dst, src, pixels, order);
+    }
+
+    void fill_alpha(uint8_t* data, size_t pixels, uint8_t alpha)
+    {
+        backend().fill_alpha(data, pixels, alpha);
+    }
+
+    void flip_vertical(uint8_t* dst, const uint8_t* src, size_t row_bytes, size_t rows)
+    {
+        if (dst != src)
+        {
+            for (size_t y = 0; y < rows; y++)
+            {
+                std::memcpy(dst + y * row_bytes, src + (rows - 1 - y) * row_bytes, row_bytes);
+            }
+            return;
+        }
+
+        // In place, swap the rows a chunk at a time through a small buffer
+        uint8_t temp[4096];
+        for (size_t y = 0; y < rows / 2; y++)
+        {
+            uint8_t* top = dst + y * row_bytes;
+            uint8_t* bottom = dst + (rows - 1 - y) * row_bytes;
+            for (size_t offset = 0; offset < row_bytes; offset += sizeof(temp))
+            {
+                size_t size = std::min(sizeof(temp), row_bytes - offset);
+                std::memcpy(temp, top + offset, size);
+                std::memcpy(top + offset, bottom + offset, size);
+                std::memcpy(bottom + offset, temp, size);
+            }
+        }
+    }
+
+    void rgba_to_rgb565(uint16_t* dst, const uint8_t* src, size_t pixels)
+    {
+        backend().rgba_to_rgb565(dst, src, pixels);
+    }
+
+    void rgb565_to_rgba(uint8_t* dst, const uint16_t* src, size_t pixels)
+    {
+        backend().rgb565_to_rgba(dst, src, pixels);
+    }
+
+    void scale_integer(uint8_t* dst, const uint8_t* src, size_t width, size_t height,
+                       size_t factor)
+    {
+        if (factor == 0)
+            return;
+
+        size_t dst_row_bytes = width * factor * 4;
+        for (size_t y = 0; y < height; y++)
+        {
+            uint8_t* row = dst + y * factor * dst_row_bytes;
+            if (factor == 2)
+                backend().scale_row_2x(row, src + y * width * 4, width);
+            else
+                scale_row_scalar(row, src + y * width * 4, width, factor);
+
+            // The other rows of this block are copies of the first
+            for (size_t i = 1; i < factor; i++)
+            {
+                std::memcpy(row + i * dst_row_bytes, row, dst_row_bytes);
+            }
+        }
+    }
+
+    const char* backend_name()
+    {
+        return backend().name;
+    }
+
+    std::vector<const char*> backend_names()
+    {
+        std::vector<const char*> names;
+        for (const Backend* backend : supported_backends())
+            names.push_back(backend->name);
+        return names;
+    }
+
+    bool set_backend(std::string_view name)
+    {
+        for (const Backend* backend : supported_backends())
+        {
+            if (name == backend->name)
+            {
+                active_backend().store(backend, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+} // namespace hydra::pixel
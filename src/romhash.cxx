@@ -0,0 +1,337 @@
+#define OPENSSL_API_COMPAT 10101
+#include <array>
+#include <cstring>
+#include <fmt/format.h>
+#include <fstream>
+#include <json.hpp>
+#include <log.h>
+#include <mappedfile.hxx>
+#include <mutex>
+#include <openssl/md5.h>
+#include <optional>
+#include <romhash.hxx>
+#include <settings.hxx>
+#include <writebehind.hxx>
+#if defined(HYDRA_LINUX) || defined(HYDRA_MACOS) || defined(HYDRA_ANDROID)
+#include <sys/stat.h>
+#endif
+
+namespace
+{
+    using json = nlohmann::json;
+
+    class Md5Hasher final : public hydra::RomHasher
+    {
+    public:
+        Md5Hasher()
+        {
+            MD5_Init(&context_);
+        }
+
+        void Update(const uint8_t* data, size_t size) override
+        {
+            MD5_Update(&context_, data, size);
+        }
+
+        std::string Finish() override
+        {
+            unsigned char result[MD5_DIGEST_LENGTH];
+            MD5_Final(result, &context_);
+            std::string hex;
+            hex.reserve(MD5_DIGEST_LENGTH * 2);
+            for (unsigned char byte : result)
+                hex += fmt::format("{:02x}", byte);
+            return hex;
+        }
+
+    private:
+        MD5_CTX context_;
+    };
+
+    // XXH64 from the xxHash specification, seed 0
+    class Xxh64Hasher final : public hydra::RomHasher
+    {
+    public:
+        void Update(const uint8_t* data, size_t size) override
+        {
+            total_ += size;
+            if (buffered_ + size < sizeof(buffer_))
+            {
+                std::memcpy(buffer_.data() + buffered_, data, size);
+                buffered_ += size;
+                return;
+            }
+
+            if (buffered_)
+            {
+                size_t fill = sizeof(buffer_) - buffered_;
+                std::memcpy(buffer_.data() + buffered_, data, fill);
+                consume_stripe(buffer_.data());
+                data += fill;
+                size -= fill;
+                buffered_ = 0;
+            }
+
+            while (size >= sizeof(buffer_))
+            {
+                consume_stripe(data);
+                data += sizeof(buffer_);
+                size -= sizeof(buffer_);
+            }
+
+            std::memcpy(buffer_.data(), data, size);
+            buffered_ = size;
+        }
+
+        std::string Finish() override
+        {
+            uint64_t hash;
+            if (total_ >= sizeof(buffer_))
+            {
+                hash = rotl(acc_[0], 1) + rotl(acc_[1], 7) + rotl(acc_[2], 12) + rotl(acc_[3], 18);
+                for (uint64_t acc : acc_)
+                    hash = (hash ^ round(0, acc)) * prime1 + prime4;
+            }
+            else
+            {
+                hash = prime5;
+            }
+            hash += total_;
+
+            const uint8_t* p = buffer_.data();
+            size_t left = buffered_;
+            for (; left >= 8; p += 8, left -= 8)
+                hash = rotl(hash ^ round(0, read64(p)), 27) * prime1 + prime4;
+            if (left >= 4)
+            {
+                hash = rotl(hash ^ (read32(p) * prime1), 23) * prime2 + prime3;
+                p += 4;
+                left -= 4;
+            }
+            for (; left > 0; p++, left--)
+                hash = rotl(hash ^ (*p * prime5), 11) * prime1;
+
+            hash ^= hash >> 33;
+            hash *= prime2;
+            hash ^= hash >> 29;
+            hash *= prime3;
+            hash ^= hash >> 32;
+            return fmt::format("{:016x}", hash);
+        }
+
+    private:
+        static constexpr uint64_t prime1 = 0x9E3779B185EBCA87;
+        static constexpr uint64_t prime2 = 0xC2B2AE3D27D4EB4F;
+        static constexpr uint64_t prime3 = 0x165667B19E3779F9;
+        static constexpr uint64_t prime4 = 0x85EBCA77C2B2AE63;
+        static constexpr uint64_t prime5 = 0x27D4EB2F165667C5;
+
+        static uint64_t rotl(uint64_t value, int bits)
+        {
+            return (value << bits) | (value >> (64 - bits));
+        }
+
+        static uint64_t round(uint64_t acc, uint64_t input)
+        {
+            return rotl(acc + input * prime2, 31) * prime1;
+        }
+
+        // The spec is defined on little endian words
+        static uint64_t read64(const uint8_t* p)
+        {
+            uint64_t value = 0;
+            for (int i = 0; i < 8; i++)
+                value |= static_cast<uint64_t>(p[i]) << (i * 8);
+            return value;
+        }
+
+        static uint64_t read32(const uint8_t* p)
+        {
+            uint64_t value = 0;
+            for (int i = 0; i < 4; i++)
+                value |= static_cast<uint64_t>(p[i]) << (i * 8);
+            return value;
+        }
+
+        void consume_stripe(const uint8_t* p)
+        {
+            for (int i = 0; i < 4; i++)
+                acc_[i] = round(acc_[i], read64(p + i * 8));
+        }
+
+        std::array<uint64_t, 4> acc_ = {prime1 + prime2, prime2, 0, 0 - prime1};
+        std::array<uint8_t, 32> buffer_;
+        size_t buffered_ = 0;
+        uint64_t total_ = 0;
+    };
+
+    struct FileIdentity
+    {
+        uint64_t size = 0;
+        int64_t mtime = 0;
+        uint64_t inode = 0;
+    };
+
+    std::optional<FileIdentity> identify(const std::filesystem::path& path)
+    {
+        std::error_code error;
+        FileIdentity id;
+        id.size = std::filesystem::file_size(path, error);
+        if (error)
+            return std::nullopt;
+        id.mtime = std::filesystem::last_write_time(path, error).time_since_epoch().count();
+        if (error)
+            return std::nullopt;
+#if defined(HYDRA_LINUX) || defined(HYDRA_MACOS) || defined(HYDRA_ANDROID)
+        // Catches a file being replaced by another one of the same size within the mtime
+        // resolution
+        struct stat st;
+        if (stat(path.c_str(), &st) == 0)
+            id.inode = st.st_ino;
+#endif
+        return id;
+    }
+
+    std::string hash_file(const std::filesystem::path& path, const hydra::RomHashAlgorithm& algo)
+    {
+        std::unique_ptr<hydra::RomHasher> hasher = algo.create();
+        hydra::MappedFile mapped(path);
+        if (mapped.Valid())
+        {
+            hasher->Update(mapped.Data(), mapped.Size());
+        }
+        else
+        {
+            // Empty files can't be mapped, and neither can some special files
+            std::ifstream file(path, std::ios::binary);
+            std::vector<char> buffer(1 << 20);
+            while (file.good())
+            {
+                file.read(buffer.data(), buffer.size());
+                hasher->Update(reinterpret_cast<const uint8_t*>(buffer.data()), file.gcount());
+            }
+        }
+        return hasher->Finish();
+    }
+
+    // In memory copy of rom_hashes.json, loaded on first use
+    class HashCache
+    {
+    public:
+        static constexpr int version = 1;
+
+        std::string Find(const std::string& path, const FileIdentity& id,
+                         const std::string& algorithm)
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            load();
+            auto entry = cache_["roms"].find(path);
+            if (entry == cache_["roms"].end() || !entry->is_object())
+                return {};
+            if ((*entry)["size"] != id.size || (*entry)["mtime"] != id.mtime ||
+                (*entry)["inode"] != id.inode)
+                return {};
+            auto hash = (*entry)["hashes"].find(algorithm);
+            if (hash == (*entry)["hashes"].end() || !hash->is_string())
+                return {};
+            return *hash;
+        }
+
+        void Store(const std::string& path, const FileIdentity& id, const std::string& algorithm,
+                   const std::string& hash)
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            load();
+            json& entry = cache_["roms"][path];
+            if (!entry.is_object() || entry["size"] != id.size || entry["mtime"] != id.mtime ||
+                entry["inode"] != id.inode)
+            {
+                entry = json::object();
+                entry["size"] = id.size;
+                entry["mtime"] = id.mtime;
+                entry["inode"] = id.inode;
+                entry["hashes"] = json::object();
+            }
+            entry["hashes"][algorithm] = hash;
+            // Only happens once per new or changed rom, so it's written right away
+            hydra::write_file_atomic(cache_path(), cache_.dump());
+        }
+
+    private:
+        static std::filesystem::path cache_path()
+        {
+            return Settings::GetCachePath() / "rom_hashes.json";
+        }
+
+        void load()
+        {
+            if (loaded_)
+                return;
+            loaded_ = true;
+
+            std::ifstream ifs(cache_path());
+            if (ifs.good())
+                cache_ = json::parse(ifs, nullptr, false);
+
+            if (!cache_.is_object() || cache_["version"] != version ||
+                !cache_["roms"].is_object())
+            {
+                cache_ = json::object();
+                cache_["version"] = version;
+                cache_["roms"] = json::object();
+            }
+        }
+
+        std::mutex mutex_;
+        json cache_;
+        bool loaded_ = false;
+    };
+
+    HashCache& hash_cache()
+    {
+        static HashCache cache;
+        return cache;
+    }
+} // namespace
+
+namespace hydra
+{
+
+    const std::vector<RomHashAlgorithm>& rom_hash_algorithms()
+    {
+        static const std::vector<RomHashAlgorithm> algorithms = {
+            {"md5", []() -> std::unique_ptr<RomHasher> { return std::make_unique<Md5Hasher>(); }},
+            {"xxh64",
+             []() -> std::unique_ptr<RomHasher> { return std::make_unique<Xxh64Hasher>(); }},
+        };
+        return algorithms;
+    }
+
+    std::string hash_rom(const std::filesystem::path& path, std::string_view algorithm)
+    {
+        const RomHashAlgorithm* algo = &rom_hash_algorithms()[0];
+        for (const RomHashAlgorithm& candidate : rom_hash_algorithms())
+        {
+            if (candidate.name == algorithm)
+                algo = &candidate;
+        }
+        if (algo->name != algorithm)
+        {
+            log_warn(fmt::format("Unknown rom hash {}, using {}", algorithm, algo->name).c_str());
+        }
+
+        std::optional<FileIdentity> id = identify(path);
+        if (!id)
+            return hash_file(path, *algo);
+
+        std::string key = std::filesystem::absolute(path).string();
+        std::string hash = hash_cache().Find(key, *id, algo->name);
+        if (hash.empty())
+        {
+            hash = hash_file(path, *algo);
+            hash_cache().Store(key, *id, algo->name, hash);
+        }
+        return hash;
+    }
+
+} // namespace hydra
@@ -0,0 +1,93 @@
+#include <algorithm>
+#include <atomic>
+#include <audiocallback.hxx>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+// Measures how long the audio device callback takes in the worst case. The consumer runs the
+// callback body on a device period schedule, while a producer thread pushes audio like a core
+// would: one video frame's worth at 60fps, or as fast as it can to stress the buffer
+
+namespace
+{
+    using bench_clock = std::chrono::steady_clock;
+
+    constexpr size_t sample_rate = 48000;
+    constexpr size_t frame_size = 2 * sizeof(float);
+    constexpr auto run_time = std::chrono::seconds(2);
+
+    struct Result
+    {
+        std::vector<uint64_t> callback_ns;
+        size_t underruns = 0;
+        size_t overruns = 0;
+    };
+
+    Result run(size_t period_frames, bool flood)
+    {
+        hydra::ringbuffer<65536 * sizeof(float)> buffer;
+        std::atomic<uint32_t> reads = 0;
+        std::atomic<uint64_t> worst_ns = 0;
+        std::atomic_bool running = true;
+
+        std::thread producer([&]() {
+            std::vector<uint8_t> chunk(sample_rate / 60 * frame_size, 0x3F);
+            auto next = bench_clock::now();
+            while (running.load(std::memory_order_relaxed))
+            {
+                if (flood)
+                {
+                    buffer.write(chunk.data(), 64 * frame_size);
+                    continue;
+                }
+                buffer.write(chunk.data(), chunk.size());
+                next += std::chrono::microseconds(1000000 / 60);
+                std::this_thread::sleep_until(next);
+            }
+        });
+
+        Result result;
+        std::vector<uint8_t> out(period_frames * frame_size);
+        auto period = std::chrono::nanoseconds(1000000000ull * period_frames / sample_rate);
+        auto end = bench_clock::now() + run_time;
+        auto next = bench_clock::now();
+        while (next < end)
+        {
+            auto start = bench_clock::now();
+            hydra::fill_audio_device(buffer, out.data(), out.size(), reads, worst_ns);
+            result.callback_ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                             bench_clock::now() - start)
+                                             .count());
+            next += period;
+            std::this_thread::sleep_until(next);
+        }
+
+        running = false;
+        producer.join();
+        result.underruns = buffer.underruns();
+        result.overruns = buffer.overruns();
+        return result;
+    }
+} // namespace
+
+int main()
+{
+    printf("%-8s %-8s %9s %9s %9s %9s %10s %10s\n", "period", "producer", "callbacks",
+           "median ns", "p99 ns", "worst ns", "underruns", "overruns");
+    for (size_t period_frames : {256, 512, 1024})
+    {
+        for (bool flood : {false, true})
+        {
+            Result result = run(period_frames, flood);
+            std::vector<uint64_t>& ns = result.callback_ns;
+            std::sort(ns.begin(), ns.end());
+            printf("%-8zu %-8s %9zu %9llu %9llu %9llu %10zu %10zu\n", period_frames,
+                   flood ? "flood" : "60fps", ns.size(), (unsigned long long)ns[ns.size() / 2],
+                   (unsigned long long)ns[ns.size() * 99 / 100],
+                   (unsigned long long)ns.back(), result.underruns, result.overruns);
+        }
+    }
+    return 0;
+}
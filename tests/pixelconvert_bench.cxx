@@ -0,0 +1,73 @@
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <pixelconvert.hxx>
+#include <vector>
+
+// Times every conversion on every backend the CPU supports, for a few common frame sizes. Prints
+// the best time per frame out of several runs, which is the least noisy number on a busy machine
+
+namespace
+{
+    using bench_clock = std::chrono::steady_clock;
+
+    double best_us_per_frame(const std::function<void()>& convert)
+    {
+        constexpr int runs = 7;
+        constexpr int frames_per_run = 50;
+        double best = 1e30;
+        for (int run = 0; run < runs; run++)
+        {
+            auto start = bench_clock::now();
+            for (int i = 0; i < frames_per_run; i++)
+                convert();
+            double us = std::chrono::duration<double, std::micro>(bench_clock::now() - start)
+                            .count() /
+                        frames_per_run;
+            best = std::min(best, us);
+        }
+        return best;
+    }
+} // namespace
+
+int main()
+{
+    struct Size
+    {
+        size_t width;
+        size_t height;
+    };
+    constexpr Size sizes[] = {{256, 224}, {400, 480}, {640, 480}, {1280, 720}};
+
+    for (Size size : sizes)
+    {
+        size_t pixels = size.width * size.height;
+        std::vector<uint8_t> rgba(pixels * 4, 0x5A);
+        std::vector<uint8_t> out(pixels * 4 * 4);
+        std::vector<uint16_t> rgb565(pixels, 0x5A5A);
+
+        printf("%zux%zu, microseconds per frame\n", size.width, size.height);
+        printf("%-8s %10s %10s %10s %10s %10s %10s\n", "backend", "swizzle", "fill_alpha",
+               "flip", "to_565", "from_565", "scale_2x");
+        for (const char* backend : hydra::pixel::backend_names())
+        {
+            hydra::pixel::set_backend(backend);
+            using namespace hydra::pixel;
+            double swizzle_us = best_us_per_frame(
+                [&]() { swizzle(out.data(), rgba.data(), pixels, swizzle_reverse); });
+            double fill_us = best_us_per_frame([&]() { fill_alpha(rgba.data(), pixels); });
+            double flip_us = best_us_per_frame(
+                [&]() { flip_vertical(rgba.data(), rgba.data(), size.width * 4, size.height); });
+            double to_565_us = best_us_per_frame(
+                [&]() { rgba_to_rgb565(rgb565.data(), rgba.data(), pixels); });
+            double from_565_us = best_us_per_frame(
+                [&]() { rgb565_to_rgba(out.data(), rgb565.data(), pixels); });
+            double scale_us = best_us_per_frame(
+                [&]() { scale_integer(out.data(), rgba.data(), size.width, size.height, 2); });
+            printf("%-8s %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n", backend, swizzle_us,
+                   fill_us, flip_us, to_565_us, from_565_us, scale_us);
+        }
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,162 @@
+#include <cstdio>
+#include <cstring>
+#include <pixelconvert.hxx>
+#include <random>
+#include <string>
+#include <vector>
+
+// Runs every conversion on every backend the CPU supports and compares the result with the scalar
+// backend. Lengths go past a few register widths and are mostly odd, so the vector loops, their
+// scalar tails and the sizes with no full register at all are all covered
+
+namespace
+{
+    int failures = 0;
+
+    void check(bool ok, const char* backend, const char* function, size_t length)
+    {
+        if (!ok)
+        {
+            printf("FAIL %s %s, length %zu\n", backend, function, length);
+            failures++;
+        }
+    }
+
+    std::vector<uint8_t> random_bytes(size_t size, std::mt19937& rng)
+    {
+        std::vector<uint8_t> bytes(size);
+        for (uint8_t& byte : bytes)
+            byte = rng();
+        return bytes;
+    }
+
+    // Output of one backend for every function, the guard bytes past the end catch overruns
+    struct Results
+    {
+        std::vector<std::vector<uint8_t>> swizzles;
+        std::vector<uint8_t> swizzle_in_place;
+        std::vector<uint8_t> fill_alpha;
+        std::vector<uint8_t> flip;
+        std::vector<uint8_t> flip_in_place;
+        std::vector<uint16_t> rgb565;
+        std::vector<uint8_t> from_rgb565;
+        std::vector<std::vector<uint8_t>> scaled;
+
+        bool operator==(const Results&) const = default;
+    };
+
+    constexpr size_t guard = 64;
+    constexpr hydra::pixel::Swizzle orders[] = {
+        hydra::pixel::swizzle_reverse, hydra::pixel::swizzle_rb, {0, 1, 2, 3}, {1, 1, 3, 0}};
+
+    Results run(size_t pixels, const std::vector<uint8_t>& rgba, const std::vector<uint16_t>& rgb565)
+    {
+        using namespace hydra::pixel;
+        Results results;
+        for (Swizzle order : orders)
+        {
+            std::vector<uint8_t> out(pixels * 4 + guard, 0xCD);
+            swizzle(out.data(), rgba.data(), pixels, order);
+            results.swizzles.push_back(out);
+        }
+
+        results.swizzle_in_place = rgba;
+        swizzle(results.swizzle_in_place.data(), results.swizzle_in_place.data(), pixels,
+                swizzle_reverse);
+
+        results.fill_alpha = rgba;
+        fill_alpha(results.fill_alpha.data(), pixels, 0x7F);
+
+        // pixels rows of 3 bytes, an odd row size on purpose
+        results.flip.assign(pixels * 3 + guard, 0xCD);
+        flip_vertical(results.flip.data(), rgba.data(), 3, pixels);
+        results.flip_in_place = rgba;
+        flip_vertical(results.flip_in_place.data(), results.flip_in_place.data(), 3, pixels);
+
+        results.rgb565.assign(pixels + guard, 0xCDCD);
+        rgba_to_rgb565(results.rgb565.data(), rgba.data(), pixels);
+
+        results.from_rgb565.assign(pixels * 4 + guard, 0xCD);
+        rgb565_to_rgba(results.from_rgb565.data(), rgb565.data(), pixels);
+
+        for (size_t factor = 1; factor <= 3; factor++)
+        {
+            // A single row of pixels and a few rows of fewer pixels
+            std::vector<uint8_t> out(pixels * factor * factor * 4 + guard, 0xCD);
+            scale_integer(out.data(), rgba.data(), pixels, 1, factor);
+            results.scaled.push_back(out);
+            out.assign(pixels * factor * factor * 4 + guard, 0xCD);
+            scale_integer(out.data(), rgba.data(), pixels / 3, 3, factor);
+            results.scaled.push_back(out);
+        }
+        return results;
+    }
+
+    void compare(const Results& expected, const Results& actual, const char* backend,
+                 size_t length)
+    {
+        check(expected.swizzles == actual.swizzles, backend, "swizzle", length);
+        check(expected.swizzle_in_place == actual.swizzle_in_place, backend, "swizzle in place",
+              length);
+        check(expected.fill_alpha == actual.fill_alpha, backend, "fill_alpha", length);
+        check(expected.flip == actual.flip, backend, "flip_vertical", length);
+        check(expected.flip_in_place == actual.flip_in_place, backend, "flip_vertical in place",
+              length);
+        check(expected.rgb565 == actual.rgb565, backend, "rgba_to_rgb565", length);
+        check(expected.from_rgb565 == actual.from_rgb565, backend, "rgb565_to_rgba", length);
+        check(expected.scaled == actual.scaled, backend, "scale_integer", length);
+    }
+} // namespace
+
+int main()
+{
+    std::vector<const char*> backends = hydra::pixel::backend_names();
+    printf("Backends:");
+    for (const char* backend : backends)
+        printf(" %s", backend);
+    printf("\n");
+
+    // A few known values, so the scalar reference itself is checked too
+    {
+        hydra::pixel::set_backend("scalar");
+        uint8_t pixel[4] = {0x11, 0x22, 0x33, 0x44};
+        hydra::pixel::swizzle(pixel, pixel, 1, hydra::pixel::swizzle_reverse);
+        check(std::memcmp(pixel, "\x44\x33\x22\x11", 4) == 0, "scalar", "swizzle value", 1);
+        uint8_t white[4] = {0xFF, 0xFF, 0xFF, 0x00};
+        uint16_t rgb565;
+        hydra::pixel::rgba_to_rgb565(&rgb565, white, 1);
+        check(rgb565 == 0xFFFF, "scalar", "rgba_to_rgb565 value", 1);
+        hydra::pixel::rgb565_to_rgba(white, &rgb565, 1);
+        check(std::memcmp(white, "\xFF\xFF\xFF\xFF", 4) == 0, "scalar", "rgb565_to_rgba value",
+              1);
+    }
+
+    std::mt19937 rng(1234);
+    for (size_t pixels = 0; pixels <= 131; pixels += (pixels < 40 ? 1 : 7))
+    {
+        std::vector<uint8_t> rgba = random_bytes(pixels * 4 + guard, rng);
+        std::vector<uint8_t> rgb565_bytes = random_bytes(pixels * 2 + guard * 2, rng);
+        std::vector<uint16_t> rgb565(pixels + guard);
+        std::memcpy(rgb565.data(), rgb565_bytes.data(), rgb565.size() * 2);
+
+        hydra::pixel::set_backend("scalar");
+        Results expected = run(pixels, rgba, rgb565);
+        for (const char* backend : backends)
+        {
+            if (!hydra::pixel::set_backend(backend))
+            {
+                check(false, backend, "set_backend", pixels);
+                continue;
+            }
+            compare(expected, run(pixels, rgba, rgb565), backend, pixels);
+        }
+    }
+
+    if (failures != 0)
+    {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    printf("All backends match the scalar reference\n");
+    return 0;
+}
@@ -0,0 +1,52 @@
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <profiler.hxx>
+#include <thread>
+#include <vector>
+
+// The owning thread pushes events as fast as it can while another thread takes snapshots, so
+// entries keep getting overwritten mid-copy. Every event carries its sequence number in all three
+// fields, a snapshot must only contain whole events, in order
+
+int main()
+{
+    auto ring = std::make_unique<hydra::ProfileRing>(0);
+    std::atomic_bool done = false;
+
+    std::thread writer([&]() {
+        for (uint64_t i = 1; i <= 5000000; i++)
+            ring->Push(reinterpret_cast<const char*>(i), i, i);
+        done = true;
+    });
+
+    int failures = 0;
+    size_t snapshots = 0;
+    std::vector<hydra::ProfileEvent> events;
+    while (!done && failures == 0)
+    {
+        events.clear();
+        ring->Snapshot(events);
+        snapshots++;
+        uint64_t previous = 0;
+        for (const hydra::ProfileEvent& event : events)
+        {
+            uint64_t name = reinterpret_cast<uint64_t>(event.name);
+            if (name != event.start_ns || name != event.duration_ns || name <= previous)
+            {
+                printf("FAIL torn or out of order event %llu %llu %llu after %llu\n",
+                       (unsigned long long)name, (unsigned long long)event.start_ns,
+                       (unsigned long long)event.duration_ns, (unsigned long long)previous);
+                failures++;
+                break;
+            }
+            previous = name;
+        }
+    }
+    writer.join();
+
+    if (failures != 0)
+        return 1;
+    printf("%zu snapshots were consistent\n", snapshots);
+    return 0;
+}
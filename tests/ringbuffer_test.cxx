@@ -0,0 +1,91 @@
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <ringbuffer.hxx>
+#include <thread>
+#include <vector>
+
+// One producer writes an increasing counter, one consumer reads it back and a third thread keeps
+// clearing the buffer. Whatever the interleaving, the consumer must see increasing values and the
+// fill level must never exceed the capacity
+
+int main()
+{
+    constexpr size_t capacity = 4096;
+    constexpr uint32_t last_value = 200000;
+    hydra::ringbuffer<capacity> buffer;
+    std::atomic_bool done = false;
+    std::atomic<size_t> clears = 0;
+    int failures = 0;
+
+    std::thread producer([&]() {
+        std::vector<uint32_t> chunk(37);
+        uint32_t value = 0;
+        while (value < last_value)
+        {
+            for (uint32_t& v : chunk)
+                v = ++value;
+            const uint8_t* data = reinterpret_cast<const uint8_t*>(chunk.data());
+            size_t left = chunk.size() * sizeof(uint32_t);
+            while (left != 0)
+            {
+                size_t written = buffer.write(data, left);
+                data += written;
+                left -= written;
+                if (left != 0)
+                    std::this_thread::yield();
+            }
+        }
+        done = true;
+    });
+
+    std::thread clearer([&]() {
+        while (!done)
+        {
+            buffer.clear();
+            clears++;
+            std::this_thread::yield();
+        }
+    });
+
+    std::vector<uint32_t> out(53);
+    uint32_t previous = 0;
+    size_t values = 0;
+    while (!done || !buffer.empty())
+    {
+        if (buffer.size() > capacity)
+        {
+            printf("FAIL fill level %zu above capacity\n", buffer.size());
+            failures++;
+            break;
+        }
+        size_t read = buffer.read(out.data(), out.size() * sizeof(uint32_t));
+        if (read % sizeof(uint32_t) != 0)
+        {
+            printf("FAIL read a partial value\n");
+            failures++;
+            break;
+        }
+        read /= sizeof(uint32_t);
+        for (size_t i = 0; i < read; i++)
+        {
+            if (out[i] <= previous)
+            {
+                printf("FAIL read %u after %u\n", out[i], previous);
+                failures++;
+                break;
+            }
+            previous = out[i];
+        }
+        values += read;
+        if (failures != 0)
+            break;
+    }
+    producer.join();
+    clearer.join();
+
+    if (failures != 0)
+        return 1;
+    printf("Read %zu values with %zu clears\n", values, clears.load());
+    return 0;
+}
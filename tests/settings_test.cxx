@@ -0,0 +1,73 @@
+#include <settings.hxx>
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Some threads keep changing a setting while others keep creating and destroying handles and
+// callbacks for it. Meant to be run under a sanitizer, a notification must never reach a handle
+// or callback that is being or has been destroyed
+
+int main()
+{
+    std::atomic_bool stop = false;
+    std::atomic<uint64_t> updates = 0;
+    std::vector<std::thread> threads;
+
+    for (int i = 0; i < 2; i++)
+    {
+        threads.emplace_back([&stop, i]() {
+            int value = 0;
+            while (!stop)
+                Settings::Set("settings_test_value", std::to_string(i * 1000000 + value++));
+        });
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        threads.emplace_back([&stop, &updates]() {
+            while (!stop)
+            {
+                auto setting = std::make_unique<hydra::Setting<int>>("settings_test_value", 0);
+                std::vector<std::unique_ptr<hydra::SettingCallback>> callbacks;
+                for (int j = 0; j < 4; j++)
+                {
+                    callbacks.push_back(std::make_unique<hydra::SettingCallback>(
+                        *setting, [&updates]() { updates++; }));
+                }
+                std::this_thread::yield();
+                callbacks.pop_back();
+                callbacks.clear();
+                setting.reset();
+            }
+        });
+    }
+
+    // A callback that destroys another one of the same setting while it is being notified
+    {
+        hydra::Setting<int> setting("settings_test_nested", 0);
+        std::unique_ptr<hydra::SettingCallback> second;
+        bool second_ran = false;
+        hydra::SettingCallback first(setting, [&second]() { second.reset(); });
+        second = std::make_unique<hydra::SettingCallback>(
+            setting, [&second_ran]() { second_ran = true; });
+        setting.Set(1);
+        if (second_ran || second)
+        {
+            printf("FAIL a destroyed callback was notified\n");
+            stop = true;
+            for (std::thread& thread : threads)
+                thread.join();
+            return 1;
+        }
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    stop = true;
+    for (std::thread& thread : threads)
+        thread.join();
+    printf("%llu notifications\n", (unsigned long long)updates.load());
+    return 0;
+}
@@ -0,0 +1,174 @@
+#include "glad.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <GLFW/glfw3.h>
+#include <pboring.hxx>
+#include <vector>
+
+// Compares the two ways ScreenWidget has uploaded software rendered frames: one glTexSubImage2D
+// per scanline to flip the frame, and a single upload through hydra::PboRing, the ring of fenced
+// pixel unpack buffers it uses now. Times include glFinish, so the GPU side of the copy is counted
+// too
+
+namespace
+{
+    using bench_clock = std::chrono::steady_clock;
+
+    constexpr int frames = 300;
+
+    void upload_per_row(GLuint texture, const uint8_t* data, int width, int height)
+    {
+        glBindTexture(GL_TEXTURE_2D, texture);
+        for (int i = 0; i < height; i++)
+        {
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, height - i - 1, width, 1, GL_RGBA,
+                            GL_UNSIGNED_BYTE, data + width * 4 * i);
+        }
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // The functions hydra::PboRing calls, like QOpenGLExtraFunctions has them. glad's functions
+    // are macros over global function pointers, so these expand to members of the same name and
+    // have to call the globals explicitly
+    struct GladFunctions
+    {
+        void glGenBuffers(GLsizei n, GLuint* buffers)
+        {
+            ::glGenBuffers(n, buffers);
+        }
+
+        void glDeleteBuffers(GLsizei n, const GLuint* buffers)
+        {
+            ::glDeleteBuffers(n, buffers);
+        }
+
+        void glBindBuffer(GLenum target, GLuint buffer)
+        {
+            ::glBindBuffer(target, buffer);
+        }
+
+        void glBufferData(GLenum target, GLsizeiptr size, const void* data, GLenum usage)
+        {
+            ::glBufferData(target, size, data, usage);
+        }
+
+        void* glMapBufferRange(GLenum target, GLintptr offset, GLsizeiptr length,
+                               GLbitfield access)
+        {
+            return ::glMapBufferRange(target, offset, length, access);
+        }
+
+        GLboolean glUnmapBuffer(GLenum target)
+        {
+            return ::glUnmapBuffer(target);
+        }
+
+        void glBindTexture(GLenum target, GLuint texture)
+        {
+            ::glBindTexture(target, texture);
+        }
+
+        void glTexSubImage2D(GLenum target, GLint level, GLint x, GLint y, GLsizei width,
+                             GLsizei height, GLenum format, GLenum type, const void* pixels)
+        {
+            ::glTexSubImage2D(target, level, x, y, width, height, format, type, pixels);
+        }
+
+        GLsync glFenceSync(GLenum condition, GLbitfield flags)
+        {
+            return ::glFenceSync(condition, flags);
+        }
+
+        GLenum glClientWaitSync(GLsync sync, GLbitfield flags, GLuint64 timeout)
+        {
+            return ::glClientWaitSync(sync, flags, timeout);
+        }
+
+        void glDeleteSync(GLsync sync)
+        {
+            ::glDeleteSync(sync);
+        }
+    };
+
+    template <class Upload>
+    double us_per_frame(Upload&& upload)
+    {
+        // Warm up so driver allocations aren't counted
+        for (int i = 0; i < 10; i++)
+            upload();
+        glFinish();
+        auto start = bench_clock::now();
+        for (int i = 0; i < frames; i++)
+            upload();
+        glFinish();
+        return std::chrono::duration<double, std::micro>(bench_clock::now() - start).count() /
+               frames;
+    }
+} // namespace
+
+int main()
+{
+    if (!glfwInit())
+    {
+        printf("glfwInit() failed\n");
+        return 1;
+    }
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    GLFWwindow* window = glfwCreateWindow(640, 480, "", nullptr, nullptr);
+    if (!window)
+    {
+        printf("glfwCreateWindow() failed\n");
+        glfwTerminate();
+        return 1;
+    }
+    glfwMakeContextCurrent(window);
+    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+    {
+        printf("gladLoadGLLoader() failed\n");
+        glfwTerminate();
+        return 1;
+    }
+    printf("Renderer: %s\n", (const char*)glGetString(GL_RENDERER));
+
+    struct Size
+    {
+        int width;
+        int height;
+    };
+    constexpr Size sizes[] = {{256, 224}, {320, 240}, {400, 480}, {640, 480}, {1280, 720}};
+
+    printf("%-10s %14s %14s\n", "size", "per row us", "pbo ring us");
+    for (Size size : sizes)
+    {
+        std::vector<uint8_t> data(size.width * size.height * 4, 0x7F);
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        // The same texture as ScreenWidget::Resize creates, the alpha channel is dropped on upload
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGB8, size.width, size.height);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        double per_row = us_per_frame(
+            [&]() { upload_per_row(texture, data.data(), size.width, size.height); });
+        double ring_us;
+        {
+            GladFunctions gl;
+            hydra::PboRing<GladFunctions> ring(gl);
+            ring.Create(data.size());
+            ring_us = us_per_frame(
+                [&]() { ring.Upload(texture, data.data(), size.width, size.height); });
+        }
+        char name[32];
+        snprintf(name, sizeof(name), "%dx%d", size.width, size.height);
+        printf("%-10s %14.1f %14.1f\n", name, per_row, ring_us);
+        glDeleteTextures(1, &texture);
+    }
+
+    glfwDestroyWindow(window);
+    glfwTerminate();
+    return 0;
+}
@@ -0,0 +1,247 @@
+#include <update.hxx>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <vector>
+
+// Runs database updates against a local server through HYDRA_DATABASE_URL and
+// HYDRA_DATABASE_VERSION_URL, in a temporary HOME. Checks that an unchanged database costs a 304,
+// that only changed files are rewritten, that removed files are deleted and that the index
+// follows
+
+namespace
+{
+    int failures = 0;
+
+    void check(bool condition, const char* what)
+    {
+        if (!condition)
+        {
+            printf("FAIL %s\n", what);
+            failures++;
+        }
+    }
+
+    std::string database_file(const std::string& name, const std::string& sub_name)
+    {
+        nlohmann::json json = {
+            {"CoreName", name},
+            {"CoreSubName", sub_name},
+            {"SystemNames", "Test System"},
+            {"Versioning", "Github"},
+            {"VersioningURL", "http://127.0.0.1/" + name},
+            {"Downloads", {{"Linux", "http://127.0.0.1/" + name + ".zip"}}},
+        };
+        return json.dump();
+    }
+
+    std::string make_zip(const std::vector<std::pair<std::string, std::string>>& files)
+    {
+        mz_zip_archive zip;
+        memset(&zip, 0, sizeof(zip));
+        mz_zip_writer_init_heap(&zip, 0, 0);
+        for (auto& [name, data] : files)
+        {
+            std::string path = "database-master/" + name;
+            mz_zip_writer_add_mem(&zip, path.c_str(), data.data(), data.size(),
+                                  MZ_DEFAULT_COMPRESSION);
+        }
+        void* buffer;
+        size_t size;
+        mz_zip_writer_finalize_heap_archive(&zip, &buffer, &size);
+        std::string result(static_cast<char*>(buffer), size);
+        mz_zip_writer_end(&zip);
+        return result;
+    }
+
+    // Serves body with an ETag and answers a matching If-None-Match with a 304
+    struct Resource
+    {
+        std::mutex mutex;
+        std::string body;
+        int version = 0;
+        std::atomic<int> full_responses = 0;
+        std::atomic<int> not_modified_responses = 0;
+
+        void set(const std::string& new_body)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            body = new_body;
+            version++;
+        }
+
+        void serve(const httplib::Request& request, httplib::Response& response)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::string etag = fmt::format("\"{}\"", version);
+            response.set_header("ETag", etag);
+            if (request.get_header_value("If-None-Match") == etag)
+            {
+                response.status = 304;
+                not_modified_responses++;
+                return;
+            }
+            response.set_content(body, "application/octet-stream");
+            full_responses++;
+        }
+    };
+
+    bool update()
+    {
+        auto done = std::make_shared<std::promise<void>>();
+        std::future<void> future = done->get_future();
+        hydra::Updater::UpdateDatabase([done]() { done->set_value(); });
+        return future.wait_for(std::chrono::seconds(10)) == std::future_status::ready;
+    }
+
+    ino_t inode(const std::filesystem::path& path)
+    {
+        struct stat st;
+        if (stat(path.string().c_str(), &st) != 0)
+            return 0;
+        return st.st_ino;
+    }
+
+    std::string core_sub_name(const hydra::DatabaseIndex& index, const std::string& core_name)
+    {
+        for (size_t i = 0; i < index.SystemCount(); i++)
+        {
+            for (size_t j = 0; j < index.EntryCount(i); j++)
+            {
+                auto entry = index.GetEntry(i, j);
+                if (entry.core_name == core_name)
+                    return std::string(entry.core_sub_name);
+            }
+        }
+        return {};
+    }
+} // namespace
+
+int main()
+{
+    std::filesystem::path home = std::filesystem::temp_directory_path() /
+                                 fmt::format("hydra_update_test_{}", getpid());
+    std::filesystem::create_directories(home);
+    setenv("HOME", home.string().c_str(), 1);
+
+    Resource zip;
+    Resource version;
+    zip.set(make_zip({{"a.json", database_file("a", "1")},
+                      {"b.json", database_file("b", "1")},
+                      {"c.json", database_file("c", "1")}}));
+    version.set(R"({"commit": {"committer": {"date": "2024-01-01T00:00:00Z"}}})");
+
+    httplib::Server server;
+    server.Get("/database.zip", [&zip](const httplib::Request& request,
+                                       httplib::Response& response) {
+        zip.serve(request, response);
+    });
+    server.Get("/version", [&version](const httplib::Request& request,
+                                      httplib::Response& response) {
+        version.serve(request, response);
+    });
+    int port = server.bind_to_any_port("127.0.0.1");
+    std::thread server_thread([&server]() { server.listen_after_bind(); });
+    server.wait_until_ready();
+
+    setenv("HYDRA_DATABASE_URL", fmt::format("http://127.0.0.1:{}/database.zip", port).c_str(),
+           1);
+    setenv("HYDRA_DATABASE_VERSION_URL", fmt::format("http://127.0.0.1:{}/version", port).c_str(),
+           1);
+    std::filesystem::path settings_path = Settings::GetSavePath() / "settings.json";
+    std::ofstream(settings_path) << "{}";
+    Settings::Open(settings_path);
+    std::filesystem::path database_path = Settings::GetSavePath() / "database";
+
+    check(update(), "first update finished");
+    check(zip.full_responses == 1, "first update downloaded the zip");
+    for (const char* name : {"a.json", "b.json", "c.json"})
+        check(std::filesystem::exists(database_path / name), "first update extracted every file");
+    ino_t a_inode = inode(database_path / "a.json");
+    ino_t b_inode = inode(database_path / "b.json");
+
+    check(hydra::Updater::NeedsDatabaseUpdate() == hydra::Updater::UpToDate,
+          "unchanged version is up to date");
+    check(version.not_modified_responses >= 1, "unchanged version check was a 304");
+
+    check(update(), "unchanged update finished");
+    check(zip.full_responses == 1 && zip.not_modified_responses == 1,
+          "unchanged database was a 304");
+    check(inode(database_path / "a.json") == a_inode, "unchanged database rewrote nothing");
+
+    zip.set(make_zip({{"a.json", database_file("a", "2")}, {"b.json", database_file("b", "1")}}));
+    check(update(), "changed update finished");
+    check(zip.full_responses == 2, "changed database was downloaded");
+    check(inode(database_path / "a.json") != a_inode, "changed file was rewritten");
+    check(inode(database_path / "b.json") == b_inode, "unchanged file was not rewritten");
+    check(!std::filesystem::exists(database_path / "c.json"), "removed file was deleted");
+
+    {
+        std::unique_ptr<hydra::DatabaseIndex> index = hydra::Updater::GetDatabase();
+        check(index != nullptr, "index is valid after the update");
+        if (index)
+        {
+            check(core_sub_name(*index, "a") == "2", "index has the changed file");
+            check(core_sub_name(*index, "c").empty(), "index dropped the removed file");
+        }
+    }
+
+    std::filesystem::remove(Settings::GetCachePath() / "database.idx");
+    {
+        std::unique_ptr<hydra::DatabaseIndex> index = hydra::Updater::GetDatabase();
+        check(index != nullptr && core_sub_name(*index, "b") == "1", "missing index is compiled");
+    }
+
+    // Readers compiling a missing index while an update replaces the files and the index
+    std::filesystem::remove(Settings::GetCachePath() / "database.idx");
+    zip.set(make_zip({{"a.json", database_file("a", "3")}, {"b.json", database_file("b", "1")}}));
+    {
+        std::vector<std::thread> readers;
+        std::atomic<int> invalid = 0;
+        auto done = std::make_shared<std::promise<void>>();
+        std::future<void> future = done->get_future();
+        hydra::Updater::UpdateDatabase([done]() { done->set_value(); });
+        for (int i = 0; i < 4; i++)
+        {
+            readers.emplace_back([&invalid]() {
+                if (!hydra::Updater::GetDatabase())
+                    invalid++;
+            });
+        }
+        for (std::thread& reader : readers)
+            reader.join();
+        check(future.wait_for(std::chrono::seconds(10)) == std::future_status::ready,
+              "concurrent update finished");
+        check(invalid == 0, "concurrent readers got an index");
+    }
+    {
+        std::unique_ptr<hydra::DatabaseIndex> index = hydra::Updater::GetDatabase();
+        check(index != nullptr && core_sub_name(*index, "a") == "3",
+              "index matches the files after concurrent compiles");
+        bool temp_files = false;
+        for (const auto& file : std::filesystem::directory_iterator(Settings::GetCachePath()))
+            temp_files |= file.path().extension() == ".tmp";
+        check(!temp_files, "no temporary files were left behind");
+    }
+
+    server.stop();
+    server_thread.join();
+    Settings::Flush();
+    std::error_code error;
+    std::filesystem::remove_all(home, error);
+
+    if (failures != 0)
+    {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    printf("Database updates behave\n");
+    return 0;
+}